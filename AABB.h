@@ -33,6 +33,7 @@ class aabb {
     }
 
     bool hit(const ray& r, interval ray_t) const {
+        RT_STAT(aabb_tests);
         const point3& ray_orig = r.origin();
         const vec3&   ray_dir  = r.direction();
 
@@ -57,6 +58,13 @@ class aabb {
         return true;
     }
 
+    double surface_area() const {
+        // Zero for an empty box, whose intervals have negative size.
+        auto dx = x.size(), dy = y.size(), dz = z.size();
+        if (dx < 0 || dy < 0 || dz < 0) return 0;
+        return 2 * (dx*dy + dy*dz + dz*dx);
+    }
+
     int longest_axis() const {
         // Returns the index of the longest axis of the bounding box.
         if (x.size() > y.size())
@@ -4,17 +4,234 @@
 #include "AABB.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "thread_pool.h"
 #include <algorithm>
+#include <vector>
+
+// How a BVH splits a set of objects: at the median along the longest axis, at the plane that
+// minimizes the surface area heuristic (SAH) cost among a number of evenly spaced bins, or
+// (linear_bvh only; bvh_node uses SAH instead) at the highest differing bit of the objects'
+// sorted Morton codes, which is quick to build but traces more slowly.
+enum class bvh_split { median, sah, morton };
+
+// How make_bvh (bvh_factory.h) lays out the scenes' trees: bvh_node objects linked by pointers, one binary
+// linear_bvh array (linear_bvh.h), or a wide_bvh with 4 or 8 children per node (wide_bvh.h).
+enum class bvh_layout { tree, linear, wide4, wide8 };
+
+struct bvh_options {
+    bvh_split split          = bvh_split::sah;
+    bvh_layout layout        = bvh_layout::linear;
+    int    bins              = 16;      // Candidate split planes per axis are bins - 1
+    int    max_leaf_size     = 4;       // Most objects a leaf may hold (SAH only)
+    double traversal_cost    = 1.0;     // Cost of visiting a node, relative to ...
+    double intersection_cost = 1.0;     // ... the cost of testing one object
+    thread_pool* pool        = nullptr; // Build large linear_bvh trees in parallel on this pool
+    double rebuild_threshold = 1.5;     // Updated linear_bvh trees are rebuilt once their SAH
+                                        // cost grows by this factor
+    int    motion_segments   = 1;       // Linear layout with moving objects: build a motion_bvh
+                                        // splitting the shutter into this many segments (0: a
+                                        // static BVH over their swept bounds)
+};
+
+// The split decisions shared by the BVH builders.
+class bvh_splitter {
+  public:
+    // Chooses how to split objects[start, end), whose bounds are given, and reorders them so the
+    // two halves are contiguous. Returns where the second half starts, or end if the objects
+    // should stay together in one leaf. Sets axis to the axis the split is across.
+    static size_t partition(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+                            const aabb& bounds, const bvh_options& options, int& axis) {
+        size_t object_span = end - start;
+        axis = bounds.longest_axis();
+        if (options.split == bvh_split::median) {
+            if (object_span <= 1)
+                return end;
+            std::sort(objects.begin() + start, objects.begin() + end,
+                [axis](const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
+                    return a->bounding_box().axis_interval(axis).min
+                         < b->bounding_box().axis_interval(axis).min;
+                });
+            return start + object_span/2;
+        }
+
+        auto max_leaf = size_t(std::max(1, options.max_leaf_size));
+
+        // Bin the object centroids along each axis and sweep the bins from both ends, pricing
+        // every plane between two bins by the expected cost of visiting the children:
+        //     traversal + (area_left * n_left + area_right * n_right) / area * intersection
+        aabb centroids = aabb::empty;
+        for (size_t k = start; k < end; k++)
+            centroids = aabb(centroids, aabb(centroid(*objects[k]), centroid(*objects[k])));
+
+        int bins = std::max(2, options.bins);
+        double area = bounds.surface_area();
+        double best_cost = infinity;
+        int best_axis = -1, best_plane = 0;
+
+        std::vector<sah_bin> binned(bins);
+        std::vector<double> right_cost(bins);
+        for (int a = 0; a < 3 && object_span > 1 && std::isfinite(area) && area > 0; a++) {
+            const auto& range = centroids.axis_interval(a);
+            if (!(range.size() > 0))
+                continue;
+
+            std::fill(binned.begin(), binned.end(), sah_bin());
+            for (size_t k = start; k < end; k++) {
+                auto& bin = binned[bin_index(*objects[k], a, range, bins)];
+                bin.bounds = aabb(bin.bounds, objects[k]->bounding_box());
+                bin.count++;
+            }
+
+            // right_cost[p] is the area-weighted count of bins p+1 and up.
+            aabb box = aabb::empty;
+            size_t count = 0;
+            for (int p = bins - 1; p > 0; p--) {
+                box = aabb(box, binned[p].bounds);
+                count += binned[p].count;
+                right_cost[p - 1] = count ? box.surface_area() * count : -1;
+            }
+
+            box = aabb::empty;
+            count = 0;
+            for (int p = 0; p < bins - 1; p++) {
+                box = aabb(box, binned[p].bounds);
+                count += binned[p].count;
+                if (count == 0 || right_cost[p] < 0)
+                    continue;
+                double cost = options.traversal_cost
+                            + (box.surface_area() * count + right_cost[p]) / area
+                              * options.intersection_cost;
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_plane = p;
+                }
+            }
+        }
+
+        double leaf_cost = object_span * options.intersection_cost;
+        if (object_span <= max_leaf && (best_axis < 0 || leaf_cost <= best_cost))
+            return end;
+
+        if (best_axis < 0) {
+            // Every centroid coincides (or the box is unbounded): split the list in half.
+            return start + object_span/2;
+        }
+
+        axis = best_axis;
+        const auto& range = centroids.axis_interval(best_axis);
+        auto split = std::partition(objects.begin() + start, objects.begin() + end,
+            [&](const shared_ptr<hittable>& object) {
+                return bin_index(*object, best_axis, range, bins) <= best_plane;
+            });
+        return size_t(split - objects.begin());
+    }
+
+  private:
+    // A bin of the SAH builder: the objects whose centroids fall into it and their bounds.
+    struct sah_bin {
+        aabb bounds = aabb::empty;
+        size_t count = 0;
+    };
+
+    static point3 centroid(const hittable& object) {
+        auto box = object.bounding_box();
+        return point3(0.5 * (box.x.min + box.x.max), 0.5 * (box.y.min + box.y.max),
+                      0.5 * (box.z.min + box.z.max));
+    }
+
+    static int bin_index(const hittable& object, int axis, const interval& range, int bins) {
+        auto c = centroid(object)[axis];
+        auto b = int(bins * (c - range.min) / range.size());
+        return std::min(std::max(b, 0), bins - 1);
+    }
+};
 
 class bvh_node : public hittable {
   public:
-    bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {}
+    // Options used by trees built without explicit ones, such as those in the scenes.
+    static bvh_options& default_options() {
+        static bvh_options options;
+        return options;
+    }
+
+    bvh_node(hittable_list list, const bvh_options& options = default_options())
+      : bvh_node(list.objects, 0, list.objects.size(), options) {}
 
-    bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+    bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+             const bvh_options& options = default_options()) {
+        render_stats::scoped_phase timing(render_phase::bvh_build);
         bbox = aabb::empty;
         for (size_t object_index=start; object_index < end; object_index++)
             bbox = aabb(bbox, objects[object_index]->bounding_box());
 
+        if (options.split == bvh_split::median)
+            build_median(objects, start, end, options);
+        else
+            build_sah(objects, start, end, options);
+
+        ray_packet::box_bounds(bbox, packet_lo, packet_hi);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_STAT(bvh_nodes);
+        if (!bbox.hit(r, ray_t))
+            return false;
+
+        if (!leaf.empty()) {
+            bool hit_anything = false;
+            for (const auto& object : leaf) {
+                if (object->hit(r, ray_t, rec)) {
+                    hit_anything = true;
+                    ray_t.max = rec.t;
+                }
+            }
+            return hit_anything;
+        }
+
+        bool hit_left = left->hit(r, ray_t, rec);
+        bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+
+        return hit_left || hit_right;
+    }
+
+    uint32_t hit_packet(ray_packet& packet, uint32_t mask, hit_record* recs) const override {
+        // Tests the packet against this node's box in SIMD and descends with the rays that
+        // overlap it. Once too few rays remain for the wide test to pay off, the packet splits
+        // and the survivors continue down the tree one at a time.
+        RT_STAT(bvh_nodes);
+        RT_STAT(packet_box_tests);
+        mask = packet.box_hit(packet_lo, packet_hi, mask);
+        if (mask == 0)
+            return 0;
+        if (ray_packet::count(mask) < min_packet_rays)
+            return hittable::hit_packet(packet, mask, recs);
+
+        if (!leaf.empty()) {
+            uint32_t hits = 0;
+            for (const auto& object : leaf)
+                hits |= object->hit_packet(packet, mask, recs);
+            return hits;
+        }
+
+        uint32_t hits = left->hit_packet(packet, mask, recs);
+        hits |= right->hit_packet(packet, mask, recs);
+        return hits;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+  private:
+    static const int min_packet_rays = 2;
+
+    shared_ptr<hittable> left;
+    shared_ptr<hittable> right;
+    std::vector<shared_ptr<hittable>> leaf;     // The objects of a leaf; empty for an interior node
+    aabb bbox;
+    float packet_lo[3], packet_hi[3];   // Padded float copy of bbox for packet traversal
+
+    void build_median(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+                      const bvh_options& options) {
         int axis = bbox.longest_axis();
 
         auto comparator = (axis == 0) ? box_x_compare
@@ -32,28 +249,23 @@ class bvh_node : public hittable {
             std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
 
             auto mid = start + object_span/2;
-            left = make_shared<bvh_node>(objects, start, mid);
-            right = make_shared<bvh_node>(objects, mid, end);
+            left = make_shared<bvh_node>(objects, start, mid, options);
+            right = make_shared<bvh_node>(objects, mid, end, options);
         }
     }
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        if (!bbox.hit(r, ray_t))
-            return false;
-
-        bool hit_left = left->hit(r, ray_t, rec);
-        bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
-
-        return hit_left || hit_right;
+    void build_sah(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+                   const bvh_options& options) {
+        int axis;
+        auto mid = bvh_splitter::partition(objects, start, end, bbox, options, axis);
+        if (mid == end) {
+            leaf.assign(objects.begin() + start, objects.begin() + end);
+            return;
+        }
+        left = make_shared<bvh_node>(objects, start, mid, options);
+        right = make_shared<bvh_node>(objects, mid, end, options);
     }
 
-    aabb bounding_box() const override { return bbox; }
-
-  private:
-    shared_ptr<hittable> left;
-    shared_ptr<hittable> right;
-    aabb bbox;
-
     static bool box_compare(
         const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index
     ) {
@@ -0,0 +1,215 @@
+#ifndef ACCUMULATION_H
+#define ACCUMULATION_H
+
+#include "rtweekend.h"
+#include "framebuffer.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Running per-pixel radiance sums and sample counts for a render in progress. This is the state a
+// checkpoint stores, and partial renders of the same scene combine by simply adding buffers.
+class accumulation_buffer {
+  public:
+    uint64_t seed = 0;  // Seed of the render that produced the samples
+
+    accumulation_buffer() {}
+
+    accumulation_buffer(int width, int height)
+      : image_width(width), image_height(height), pixels(size_t(width) * height) {}
+
+    int width() const  { return image_width; }
+    int height() const { return image_height; }
+
+    void add_sample(int i, int j, const color& c) {
+        auto& p = at(i, j);
+        p.sum += c;
+        double lum = luminance(c);
+        p.sum_lum_sq += lum * lum;
+        p.count++;
+    }
+
+    int samples(int i, int j) const { return int(at(i, j).count); }
+
+    color mean(int i, int j) const {
+        const auto& p = at(i, j);
+        return p.count > 0 ? p.sum / p.count : color(0,0,0);
+    }
+
+    // Standard error of the pixel's mean luminance.
+    double standard_error(int i, int j) const {
+        const auto& p = at(i, j);
+        if (p.count < 2) return infinity;
+        double n = p.count;
+        double mean_lum = luminance(p.sum) / n;
+        double variance = std::fmax(0.0, (p.sum_lum_sq - n * mean_lum * mean_lum) / (n - 1));
+        return std::sqrt(variance / n);
+    }
+
+    long long total_samples() const {
+        long long total = 0;
+        for (const auto& p : pixels) total += p.count;
+        return total;
+    }
+
+    // Adds another buffer's samples to this one. Both must cover the same image size.
+    bool merge(const accumulation_buffer& other) {
+        if (other.image_width != image_width || other.image_height != image_height)
+            return false;
+        for (size_t k = 0; k < pixels.size(); k++) {
+            pixels[k].sum += other.pixels[k].sum;
+            pixels[k].sum_lum_sq += other.pixels[k].sum_lum_sq;
+            pixels[k].count += other.pixels[k].count;
+        }
+        return true;
+    }
+
+    void resolve(framebuffer& image) const {
+        for (int j = 0; j < image_height; j++)
+            for (int i = 0; i < image_width; i++)
+                image.set(i, j, mean(i, j));
+    }
+
+    // File layout: an 8-byte magic, width and height (uint32), the seed (uint64), then for each
+    // pixel in scanline order its RGB radiance sums and sum of squared luminance as float64
+    // followed by the sample count as uint32, all little-endian. These are the raw sums, so a
+    // loaded buffer continues exactly as the saved one would have. The file is written under a
+    // temporary name and renamed over the old one in one step, so a crash at any point leaves
+    // the previous checkpoint or the new one intact.
+    bool save(const std::string& path) const {
+        auto temp_path = path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary);
+            if (!out) return false;
+
+            out.write(magic, 8);
+            put_u32(out, uint32_t(image_width));
+            put_u32(out, uint32_t(image_height));
+            put_u32(out, uint32_t(seed));
+            put_u32(out, uint32_t(seed >> 32));
+
+            std::vector<unsigned char> record(size_t(image_width) * bytes_per_pixel);
+            for (int j = 0; j < image_height; j++) {
+                unsigned char* dst = record.data();
+                for (int i = 0; i < image_width; i++) {
+                    const auto& p = at(i, j);
+                    store_f64(dst + 0,  p.sum.x());
+                    store_f64(dst + 8,  p.sum.y());
+                    store_f64(dst + 16, p.sum.z());
+                    store_f64(dst + 24, p.sum_lum_sq);
+                    store_u32(dst + 32, p.count);
+                    dst += bytes_per_pixel;
+                }
+                out.write(reinterpret_cast<const char*>(record.data()), record.size());
+            }
+            if (!out) return false;
+        }
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        if (error) {
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+        return true;
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+
+        char header[8];
+        in.read(header, 8);
+        if (!in || std::memcmp(header, magic, 8) != 0) {
+            if (in && std::memcmp(header, "RTACCUM1", 8) == 0)
+                std::cerr << path << " is an accumulation file of an older format.\n";
+            else
+                std::cerr << path << " is not an accumulation file.\n";
+            return false;
+        }
+
+        uint32_t w = get_u32(in), h = get_u32(in);
+        uint64_t seed_lo = get_u32(in), seed_hi = get_u32(in);
+        if (!in) return false;
+
+        *this = accumulation_buffer(int(w), int(h));
+        seed = seed_lo | (seed_hi << 32);
+
+        std::vector<unsigned char> record(size_t(image_width) * bytes_per_pixel);
+        for (int j = 0; j < image_height; j++) {
+            in.read(reinterpret_cast<char*>(record.data()), record.size());
+            if (!in) {
+                std::cerr << path << " is truncated.\n";
+                return false;
+            }
+            const unsigned char* src = record.data();
+            for (int i = 0; i < image_width; i++) {
+                auto& p = at(i, j);
+                p.sum = color(load_f64(src), load_f64(src + 8), load_f64(src + 16));
+                p.sum_lum_sq = load_f64(src + 24);
+                p.count = load_u32(src + 32);
+                src += bytes_per_pixel;
+            }
+        }
+        return true;
+    }
+
+    static double luminance(const color& c) {
+        return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+    }
+
+  private:
+    struct pixel {
+        color sum;
+        double sum_lum_sq = 0;
+        uint32_t count = 0;
+    };
+
+    static constexpr const char* magic = "RTACCUM2";
+    static const int bytes_per_pixel = 36;
+
+    int image_width = 0;
+    int image_height = 0;
+    std::vector<pixel> pixels;
+
+    pixel& at(int i, int j) { return pixels[size_t(j) * image_width + i]; }
+    const pixel& at(int i, int j) const { return pixels[size_t(j) * image_width + i]; }
+
+    static void store_u32(unsigned char* dst, uint32_t v) {
+        for (int b = 0; b < 4; b++) dst[b] = (unsigned char)(v >> (8 * b));
+    }
+
+    static uint32_t load_u32(const unsigned char* src) {
+        return uint32_t(src[0]) | uint32_t(src[1]) << 8 | uint32_t(src[2]) << 16
+             | uint32_t(src[3]) << 24;
+    }
+
+    static void store_f64(unsigned char* dst, double d) {
+        uint64_t bits;
+        std::memcpy(&bits, &d, 8);
+        store_u32(dst, uint32_t(bits));
+        store_u32(dst + 4, uint32_t(bits >> 32));
+    }
+
+    static double load_f64(const unsigned char* src) {
+        uint64_t bits = load_u32(src) | uint64_t(load_u32(src + 4)) << 32;
+        double d;
+        std::memcpy(&d, &bits, 8);
+        return d;
+    }
+
+    static void put_u32(std::ostream& out, uint32_t v) {
+        unsigned char bytes[4];
+        store_u32(bytes, v);
+        out.write(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    static uint32_t get_u32(std::istream& in) {
+        unsigned char bytes[4] = {0, 0, 0, 0};
+        in.read(reinterpret_cast<char*>(bytes), 4);
+        return load_u32(bytes);
+    }
+};
+
+#endif
@@ -0,0 +1,628 @@
+// Reproducible performance benchmark. Renders each built-in scene at a fixed, reduced size with
+// fixed seeds, once per thread count, and reports render time, ray throughput, peak memory and
+// scaling. Results can be saved as a baseline that later runs are checked against. With --check
+// it instead runs correctness checks that timings alone would not catch.
+#include "rtweekend.h"
+#include "camera.h"
+#include "scenes.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX        // This file calls std::max, which windows.h's max macro would break
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+// One scene of the suite, at a size that renders in a second or two on one core.
+struct benchmark_case {
+    std::string scene;
+    int image_width;
+    int samples_per_pixel;
+    int max_depth;
+};
+
+const std::vector<benchmark_case>& benchmark_suite() {
+    static const std::vector<benchmark_case> cases = {
+        {"bouncing_spheres", 240, 8,  10},
+        {"cornell_box",      200, 16, 10},
+        {"cornell_smoke",    200, 16, 10},
+        {"final_scene",      200, 16, 4},
+        {"final_submission", 240, 8,  10},
+        {"tri_test",         240, 8,  10},
+    };
+    return cases;
+}
+
+struct benchmark_result {
+    std::string scene;
+    int threads = 0;
+    double build_seconds = 0;       // Scene and BVH construction
+    double render_seconds = 0;      // Fastest render over the repeats
+    double mrays_per_second = 0;    // Scene and shadow rays of that render
+    double peak_mb = 0;             // Peak resident memory since the case started (see peak_memory_mb)
+};
+
+struct benchmark_options {
+    std::vector<std::string> scenes;    // Empty = the whole suite
+    std::vector<int> thread_counts;
+    int repeats = 3;
+    std::string output_dir = "benchmark_output";
+    std::string baseline_filename;
+    std::string save_baseline_filename;
+    bool check = false;                 // Run the correctness checks instead of the suite
+};
+
+void print_usage() {
+    std::clog <<
+        "Usage: benchmark [OPTIONS]\n"
+        "\n"
+        "Renders each scene of the benchmark suite at a fixed size and seed, once per thread\n"
+        "count, and reports render time, Mrays/s, peak memory and scaling.\n"
+        "\n"
+        "Options:\n"
+        "  --scene NAME          run only this scene (may be repeated)\n"
+        "  --threads LIST        comma-separated thread counts (default 1, 2, 4, ... and one\n"
+        "                        per hardware thread)\n"
+        "  --repeat N            renders per measurement; the fastest counts (default 3)\n"
+        "  --out-dir DIR         directory for the rendered images (default benchmark_output)\n"
+        "  --bvh BUILDER         sah (default), median or morton\n"
+        "  --bvh-layout LAYOUT   linear (default), tree, wide4 or wide8\n"
+        "  --motion-segments N   time segments of BVHs over moving objects (default 1)\n"
+        "  --baseline FILE       compare against FILE and exit with 1 on any regression\n"
+        "  --save-baseline FILE  write the results to FILE as a new baseline\n"
+        "  --check               run the correctness checks instead, exiting with 1 on a failure\n"
+        "  --list                list the suite\n";
+}
+
+// Peak resident memory of the process in MB. On Linux the peak is reset before each case, though
+// it still counts memory the allocator kept resident after an earlier case freed it; elsewhere
+// it is the high-water mark of the whole run so far. Run a case alone (--scene) to isolate it.
+void reset_peak_memory() {
+#if defined(__linux__)
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+double peak_memory_mb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+#if defined(__linux__)
+    // getrusage ignores the reset, but VmHWM honours it.
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line); )
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stod(line.substr(6)) / 1024.0;
+#endif
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / (1024.0 * 1024.0);    // Bytes
+#else
+    return usage.ru_maxrss / 1024.0;               // Kilobytes
+#endif
+#endif
+}
+
+std::vector<int> default_thread_counts() {
+    int hardware = std::max(1, int(std::thread::hardware_concurrency()));
+    std::vector<int> counts;
+    for (int n = 1; n < hardware; n *= 2)
+        counts.push_back(n);
+    counts.push_back(hardware);
+    return counts;
+}
+
+bool parse_thread_counts(const std::string& text, std::vector<int>& counts) {
+    std::istringstream in(text);
+    for (std::string item; std::getline(in, item, ','); ) {
+        int n = std::atoi(item.c_str());
+        if (n < 1)
+            return false;
+        counts.push_back(n);
+    }
+    return !counts.empty();
+}
+
+// Builds one case's scene and renders it at every thread count.
+std::vector<benchmark_result> run_case(const benchmark_case& bench, const benchmark_options& options) {
+    reset_peak_memory();
+
+    // Scenes draw from the calling thread's random stream while they are built, so restart it
+    // to build the same scene as a fresh raytracer process does.
+    thread_rng() = rng_stream();
+
+    // Large BVHs build in parallel on one thread per hardware thread, whatever the render uses.
+    thread_pool build_pool;
+    bvh_node::default_options().pool = &build_pool;
+
+    hittable_list world, lights;
+    camera cam;
+    auto build_start = std::chrono::steady_clock::now();
+    find_scene(bench.scene)->build(world, lights, cam);
+    std::chrono::duration<double> build_time = std::chrono::steady_clock::now() - build_start;
+    bvh_node::default_options().pool = nullptr;
+
+    cam.image_width = bench.image_width;
+    cam.samples_per_pixel = bench.samples_per_pixel;
+    cam.max_depth = bench.max_depth;
+    cam.seed = 1;
+    cam.show_progress = false;
+    cam.show_statistics = false;
+    cam.output_filename = (std::filesystem::path(options.output_dir) / (bench.scene + ".ppm")).string();
+
+    std::vector<benchmark_result> results;
+    for (int threads : options.thread_counts) {
+        benchmark_result result;
+        result.scene = bench.scene;
+        result.threads = threads;
+        result.build_seconds = build_time.count();
+
+        thread_pool pool(threads);
+        for (int k = 0; k < options.repeats; k++) {
+            cam.render(world, lights, pool);
+            const auto& report = cam.last_report();
+            double seconds = report.phase(render_phase::render);
+            if (k == 0 || seconds < result.render_seconds) {
+                result.render_seconds = seconds;
+                result.mrays_per_second = report.rays_per_second() / 1e6;
+            }
+        }
+        result.peak_mb = peak_memory_mb();
+        results.push_back(result);
+    }
+    return results;
+}
+
+void print_results(const std::vector<benchmark_result>& results) {
+    auto flags = std::cout.flags();
+    auto precision = std::cout.precision();
+    std::cout << std::left << std::setw(18) << "scene" << std::right
+              << std::setw(8) << "threads" << std::setw(10) << "build s" << std::setw(10)
+              << "render s" << std::setw(10) << "Mrays/s" << std::setw(9) << "speedup"
+              << std::setw(12) << "efficiency" << std::setw(10) << "peak MB" << '\n';
+
+    for (const auto& r : results) {
+        // Scaling is measured against the same scene's run on the fewest threads.
+        const benchmark_result* base = nullptr;
+        for (const auto& other : results)
+            if (other.scene == r.scene && (!base || other.threads < base->threads))
+                base = &other;
+        double speedup = r.render_seconds > 0 ? base->render_seconds / r.render_seconds : 0;
+        double efficiency = speedup * base->threads / r.threads;
+
+        std::cout << std::left << std::setw(18) << r.scene << std::right << std::fixed
+                  << std::setw(8) << r.threads
+                  << std::setprecision(3) << std::setw(10) << r.build_seconds
+                  << std::setw(10) << r.render_seconds
+                  << std::setprecision(2) << std::setw(10) << r.mrays_per_second
+                  << std::setw(8) << speedup << 'x'
+                  << std::setprecision(0) << std::setw(11) << 100 * efficiency << '%'
+                  << std::setprecision(1) << std::setw(10) << r.peak_mb << '\n';
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+// A saved set of results and how far a later run may drift from them before it counts as a
+// regression. Text, one result per line:
+//
+//     tolerance seconds 0.10
+//     tolerance memory 0.15
+//     SCENE THREADS RENDER_SECONDS MRAYS_PER_S PEAK_MB
+//
+// Everything after a '#' is a comment.
+struct benchmark_baseline {
+    double time_tolerance = 0.10;       // Allowed fractional increase in render time
+    double memory_tolerance = 0.15;     // Allowed fractional increase in peak memory
+    std::vector<benchmark_result> results;
+
+    bool load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in)
+            return false;
+        std::string line;
+        while (std::getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string first;
+            if (!(fields >> first))
+                continue;
+
+            if (first == "tolerance") {
+                std::string metric;
+                double value;
+                if (!(fields >> metric >> value))
+                    return false;
+                if (metric == "seconds")     time_tolerance = value;
+                else if (metric == "memory") memory_tolerance = value;
+                else return false;
+                continue;
+            }
+
+            benchmark_result r;
+            r.scene = first;
+            if (!(fields >> r.threads >> r.render_seconds >> r.mrays_per_second >> r.peak_mb))
+                return false;
+            results.push_back(r);
+        }
+        return true;
+    }
+
+    bool save(const std::string& path) const {
+        std::ofstream out(path);
+        out << "# Benchmark baseline, written by benchmark --save-baseline. Times depend on the\n"
+            << "# machine, so record a baseline on the machine that checks against it.\n"
+            << "tolerance seconds " << time_tolerance << '\n'
+            << "tolerance memory " << memory_tolerance << '\n'
+            << "# SCENE THREADS RENDER_SECONDS MRAYS_PER_S PEAK_MB\n";
+        for (const auto& r : results)
+            out << r.scene << ' ' << r.threads << ' ' << r.render_seconds << ' '
+                << r.mrays_per_second << ' ' << r.peak_mb << '\n';
+        return bool(out);
+    }
+
+    const benchmark_result* find(const std::string& scene, int threads) const {
+        for (const auto& r : results)
+            if (r.scene == scene && r.threads == threads)
+                return &r;
+        return nullptr;
+    }
+
+    // Prints how each result compares with its baseline; returns the number of regressions.
+    int compare(const std::vector<benchmark_result>& current) const {
+        int regressions = 0;
+        auto flags = std::cout.flags();
+        auto precision = std::cout.precision();
+        std::cout << std::fixed << std::setprecision(1) << "\nAgainst the baseline (tolerance " << 100 * time_tolerance << "% time, "
+                  << 100 * memory_tolerance << "% memory):\n";
+        for (const auto& r : current) {
+            std::cout << "  " << std::left << std::setw(18) << r.scene << std::right
+                      << std::setw(3) << r.threads << " threads: ";
+            auto base = find(r.scene, r.threads);
+            if (!base) {
+                std::cout << "no baseline\n";
+                continue;
+            }
+
+            double time_change = r.render_seconds / base->render_seconds - 1;
+            double memory_change = base->peak_mb > 0 ? r.peak_mb / base->peak_mb - 1 : 0;
+            bool slower = time_change > time_tolerance;
+            bool larger = memory_change > memory_tolerance;
+            std::cout << std::showpos << 100 * time_change << "% time, "
+                      << 100 * memory_change << "% memory" << std::noshowpos;
+            if (slower || larger) {
+                std::cout << "  REGRESSION";
+                regressions++;
+            } else if (time_change < -time_tolerance) {
+                std::cout << "  faster; consider updating the baseline";
+            }
+            std::cout << '\n';
+        }
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+        return regressions;
+    }
+};
+
+// True if the two files exist and hold the same bytes.
+bool same_file_bytes(const std::string& a, const std::string& b) {
+    std::ifstream in_a(a, std::ios::binary), in_b(b, std::ios::binary);
+    if (!in_a || !in_b)
+        return false;
+    std::string bytes_a((std::istreambuf_iterator<char>(in_a)), std::istreambuf_iterator<char>());
+    std::string bytes_b((std::istreambuf_iterator<char>(in_b)), std::istreambuf_iterator<char>());
+    return bytes_a == bytes_b;
+}
+
+// Renders cornell_box with adaptive sampling once straight through and once stopped at a
+// checkpoint and resumed, and checks that the two PFMs are identical: a checkpoint must carry
+// the exact accumulator state, or resumed pixels converge at different sample counts.
+bool check_resume(const benchmark_options& options) {
+    auto directory = std::filesystem::path(options.output_dir);
+    auto checkpoint = (directory / "check_resume.accum").string();
+    std::remove(checkpoint.c_str());
+
+    auto render = [&](const std::string& output, int max_samples, bool checkpointing) {
+        thread_rng() = rng_stream();
+        hittable_list world, lights;
+        camera cam;
+        find_scene("cornell_box")->build(world, lights, cam);
+        cam.image_width = 64;
+        cam.samples_per_pixel = 16;
+        cam.max_depth = 10;
+        cam.seed = 1;
+        cam.adaptive_sampling = true;
+        cam.adaptive_min_samples = 8;
+        cam.adaptive_max_samples = max_samples;
+        cam.show_progress = false;
+        cam.show_statistics = false;
+        cam.output_filename = (directory / output).string();
+        if (checkpointing) {
+            cam.checkpoint_filename = checkpoint;
+            cam.checkpoint_pass_samples = 8;
+            cam.resume = true;
+        }
+        cam.render(world, lights);
+    };     // The camera finishes writing its image when it is destroyed
+
+    render("check_resume_direct.pfm", 48, false);
+    render("check_resume_resumed.pfm", 20, true);
+    render("check_resume_resumed.pfm", 48, true);
+    std::remove(checkpoint.c_str());
+    return same_file_bytes((directory / "check_resume_direct.pfm").string(),
+                           (directory / "check_resume_resumed.pfm").string());
+}
+
+// Traces rays from 10^4 to 10^6 units away at points just inside the corners of small quads,
+// where they graze the boxes of the BVH leaves, and checks that every layout and the packet path
+// hit what testing each quad does. Their float slab tests round the ray origin, which at that
+// distance moves a slab by far more than the boxes are padded, so they must allow for it.
+bool check_far_origin_rays(const benchmark_options&) {
+    thread_rng() = rng_stream();
+    auto mat = make_shared<lambertian>(color(.5, .5, .5));
+    hittable_list quads;
+    std::vector<std::array<point3, 4>> corners;
+    for (int k = 0; k < 256; k++) {
+        auto Q = vec3::random(-4, 4);
+        auto u = random_unit_vector(), v = random_unit_vector();
+        quads.add(make_shared<quad>(Q, u, v, mat));
+        corners.push_back({Q, Q + u, Q + v, Q + u + v});
+    }
+
+    std::vector<ray> rays;
+    for (int k = 0; k < 4096; k++) {
+        const auto& quad_corners = corners[random_int(0, int(corners.size()) - 1)];
+        auto center = 0.25 * (quad_corners[0] + quad_corners[1] + quad_corners[2] + quad_corners[3]);
+        auto corner = quad_corners[random_int(0, 3)];
+        auto target = corner + 1e-6 * (center - corner);
+        auto distance = std::pow(10.0, random_double(4, 6));
+        auto origin = target + distance * random_unit_vector();
+        rays.emplace_back(origin, target - origin);
+    }
+
+    std::vector<shared_ptr<hittable>> layouts = {
+        make_shared<linear_bvh>(quads), make_shared<wide_bvh<4>>(quads),
+        make_shared<wide_bvh<8>>(quads)
+    };
+    auto same = [](bool hit, const hit_record& rec, bool expected_hit, const hit_record& expected) {
+        return hit == expected_hit && (!hit || rec.t == expected.t);
+    };
+
+    int mismatches = 0;
+    for (size_t base = 0; base < rays.size(); base += 8) {
+        bool expected_hit[8];
+        hit_record expected[8];
+        ray_packet packet;
+        for (size_t k = 0; k < 8; k++) {
+            expected_hit[k] = quads.hit(rays[base + k], interval(0.001, infinity), expected[k]);
+            packet.add(rays[base + k]);
+        }
+        for (size_t k = 0; k < 8; k++) {
+            for (const auto& layout : layouts) {
+                hit_record rec;
+                bool hit = layout->hit(rays[base + k], interval(0.001, infinity), rec);
+                mismatches += same(hit, rec, expected_hit[k], expected[k]) ? 0 : 1;
+            }
+        }
+        hit_record recs[ray_packet::max_size];
+        uint32_t hits = layouts[0]->hit_packet(packet, packet.all(), recs);
+        for (int k = 0; k < 8; k++)
+            mismatches += same(hits & (1u << k), recs[k], expected_hit[k], expected[k]) ? 0 : 1;
+    }
+    return mismatches == 0;
+}
+
+// Moves an instance of a scaled instance inside a linear_bvh and refits it, then checks that
+// rays hit it where an instance built at the new place directly is hit: moving the outer
+// instance must keep the scale it folded in from the inner one.
+bool check_nested_instance_refit(const benchmark_options&) {
+    thread_rng() = rng_stream();
+    auto mat = make_shared<lambertian>(color(.5, .5, .5));
+    auto unit = make_shared<sphere>(point3(0, 0, 0), 1, mat);
+    auto scale = affine_transform::scaling(vec3(2, 0.5, 1));
+    auto start = affine_transform::translation(vec3(-3, 0, 0));
+    auto moved = affine_transform::translation(vec3(3, 1, 0)) * affine_transform::rotation_y(30);
+
+    auto placed = make_shared<instance>(make_shared<instance>(unit, scale), start);
+    hittable_list objects;
+    objects.add(placed);
+    objects.add(make_shared<sphere>(point3(0, -10, 0), 2, mat));
+    linear_bvh tree(objects);
+    placed->set_transform(moved);
+    tree.refit();
+
+    instance expected(make_shared<instance>(unit, scale), moved);
+    int mismatches = 0;
+    for (int k = 0; k < 4096; k++) {
+        auto origin = 8 * random_unit_vector();
+        ray r(origin, vec3::random(-3, 3) + point3(3, 1, 0) - origin);
+        hit_record rec, expected_rec;
+        bool hit = tree.hit(r, interval(0.001, infinity), rec);
+        bool expected_hit = expected.hit(r, interval(0.001, infinity), expected_rec);
+        if (expected_hit && (!hit || rec.t != expected_rec.t))
+            mismatches++;
+    }
+    for (int row = 0; row < 3; row++)
+        for (int col = 0; col < 4; col++)
+            if (placed->transform().m[row][col] != moved.m[row][col])
+                mismatches++;
+    return mismatches == 0;
+}
+
+// Runs every check and prints its outcome; returns the number that failed.
+int run_checks(const benchmark_options& options) {
+    struct named_check {
+        const char* name;
+        bool (*run)(const benchmark_options&);
+    };
+    static const named_check checks[] = {
+        {"resumed render matches direct render", check_resume},
+        {"far-origin grazing rays hit alike in every layout", check_far_origin_rays},
+        {"refit of a moved nested instance keeps its inner transform", check_nested_instance_refit},
+    };
+
+    int failures = 0;
+    for (const auto& check : checks) {
+        bool passed = check.run(options);
+        std::cout << (passed ? "pass  " : "FAIL  ") << check.name << '\n';
+        failures += passed ? 0 : 1;
+    }
+    return failures;
+}
+
+bool parse_options(int argc, char* argv[], benchmark_options& options) {
+    for (int k = 1; k < argc; k++) {
+        std::string token = argv[k];
+        if (token == "--help" || token == "-h") {
+            print_usage();
+            std::exit(0);
+        }
+        if (token == "--list") {
+            for (const auto& bench : benchmark_suite())
+                std::cout << bench.scene << ": " << bench.image_width << " wide, "
+                          << bench.samples_per_pixel << " spp, depth " << bench.max_depth << '\n';
+            std::exit(0);
+        }
+        if (token == "--check") {
+            options.check = true;
+            continue;
+        }
+
+        if (k + 1 >= argc) {
+            std::cerr << "Missing value for " << token << ".\n";
+            return false;
+        }
+        std::string value = argv[++k];
+
+        if (token == "--scene") {
+            auto& suite = benchmark_suite();
+            bool known = std::any_of(suite.begin(), suite.end(),
+                                     [&](const benchmark_case& b) { return b.scene == value; });
+            if (!known) {
+                std::cerr << "Scene '" << value << "' is not in the benchmark suite (see --list).\n";
+                return false;
+            }
+            options.scenes.push_back(value);
+        } else if (token == "--threads") {
+            if (!parse_thread_counts(value, options.thread_counts)) {
+                std::cerr << "Bad thread counts '" << value << "'.\n";
+                return false;
+            }
+        } else if (token == "--repeat") {
+            options.repeats = std::max(1, std::atoi(value.c_str()));
+        } else if (token == "--out-dir") {
+            options.output_dir = value;
+        } else if (token == "--bvh") {
+            if (value == "sah")         bvh_node::default_options().split = bvh_split::sah;
+            else if (value == "median") bvh_node::default_options().split = bvh_split::median;
+            else if (value == "morton") bvh_node::default_options().split = bvh_split::morton;
+            else {
+                std::cerr << "Unknown BVH builder '" << value << "'.\n";
+                return false;
+            }
+        } else if (token == "--motion-segments") {
+            bvh_node::default_options().motion_segments = std::max(0, std::atoi(value.c_str()));
+        } else if (token == "--bvh-layout") {
+            if (value == "linear")     bvh_node::default_options().layout = bvh_layout::linear;
+            else if (value == "tree")  bvh_node::default_options().layout = bvh_layout::tree;
+            else if (value == "wide4") bvh_node::default_options().layout = bvh_layout::wide4;
+            else if (value == "wide8") bvh_node::default_options().layout = bvh_layout::wide8;
+            else {
+                std::cerr << "Unknown BVH layout '" << value << "'.\n";
+                return false;
+            }
+        } else if (token == "--baseline") {
+            options.baseline_filename = value;
+        } else if (token == "--save-baseline") {
+            options.save_baseline_filename = value;
+        } else {
+            std::cerr << "Unknown option " << token << ".\n";
+            return false;
+        }
+    }
+    if (options.thread_counts.empty())
+        options.thread_counts = default_thread_counts();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    benchmark_options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    benchmark_baseline baseline;
+    if (!options.baseline_filename.empty() && !baseline.load(options.baseline_filename)) {
+        std::cerr << "Could not read baseline " << options.baseline_filename << ".\n";
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options.output_dir, error);
+    if (error) {
+        std::cerr << "Could not create " << options.output_dir << ": " << error.message() << ".\n";
+        return 1;
+    }
+
+    if (options.check) {
+        int failures = run_checks(options);
+        if (failures > 0) {
+            std::cout << failures << " check" << (failures == 1 ? "" : "s") << " failed.\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    std::vector<benchmark_result> results;
+    for (const auto& bench : benchmark_suite()) {
+        if (!options.scenes.empty()
+            && std::find(options.scenes.begin(), options.scenes.end(), bench.scene) == options.scenes.end())
+            continue;
+        std::clog << "Running " << bench.scene << "...\n";
+        auto case_results = run_case(bench, options);
+        results.insert(results.end(), case_results.begin(), case_results.end());
+    }
+    std::cout << '\n';
+    print_results(results);
+
+    int regressions = 0;
+    if (!options.baseline_filename.empty())
+        regressions = baseline.compare(results);
+
+    if (!options.save_baseline_filename.empty()) {
+        benchmark_baseline saved;
+        saved.time_tolerance = baseline.time_tolerance;
+        saved.memory_tolerance = baseline.memory_tolerance;
+        saved.results = results;
+        if (!saved.save(options.save_baseline_filename)) {
+            std::cerr << "Could not write baseline " << options.save_baseline_filename << ".\n";
+            return 1;
+        }
+    }
+
+    if (regressions > 0) {
+        std::cout << regressions << " regression" << (regressions == 1 ? "" : "s") << ".\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef BVH_FACTORY_H
+#define BVH_FACTORY_H
+
+#include "BVH.h"
+#include "linear_bvh.h"
+#include "motion_bvh.h"
+#include "wide_bvh.h"
+
+// Builds the scenes' acceleration structures in the layout the default options ask for, as a
+// motion_bvh when the layout is linear and any of the objects move.
+inline shared_ptr<hittable> make_bvh(hittable_list list) {
+    const auto& options = bvh_node::default_options();
+    if (options.layout == bvh_layout::linear && options.motion_segments > 0
+        && motion_bvh::has_motion(list))
+        return make_shared<motion_bvh>(std::move(list));
+    switch (options.layout) {
+        case bvh_layout::tree:   return make_shared<bvh_node>(std::move(list));
+        case bvh_layout::wide4:  return make_shared<wide_bvh<4>>(std::move(list));
+        case bvh_layout::wide8:  return make_shared<wide_bvh<8>>(std::move(list));
+        default:                 return make_shared<linear_bvh>(std::move(list));
+    }
+}
+
+#endif
@@ -2,9 +2,23 @@
 #define CAMERA_H
 
 #include "hittable.h"
+#include "hittable_list.h"
 #include "material.h"
-#include <fstream>
+#include "sampler.h"
+#include "accumulation.h"
+#include "denoiser.h"
+#include "framebuffer.h"
+#include "heatmap.h"
+#include "image_writer.h"
+#include "thread_pool.h"
+#include "wavefront.h"
+#include <atomic>
 #include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
 
 class camera {
   public:
@@ -19,37 +33,211 @@ class camera {
     vec3   vup      = vec3(0,1,0);              // "Up" direction for camera
     double defocus_angle = 0;                   // Variation angle of rays through each pixel
     double focus_dist = 10;                     // Distance from camera lookfrom point to plane of perfect focus
-    std::string output_filename = "image.ppm";  // Output file name
+    std::string output_filename = "image.ppm";  // Output file name (.ppm, .png or .pfm picks the format)
+    bool   stream_to_stdout = false;            // Also stream finished rows to stdout as binary PPM
+    bool   open_output      = false;            // Open the image with the system viewer once written
+    bool   show_progress    = true;             // Print a progress line while rendering
+
+    int    num_threads  = 0;                    // Render worker threads (0 = one per hardware thread)
+    int    tile_size    = 16;                   // Edge length in pixels of a square render tile
+    uint64_t seed       = 0;                    // Base seed for the per-sample random streams
+    task_priority priority = task_priority::normal; // Scheduling priority when sharing a thread pool
+    sampler_type sampler_kind = sampler_type::sobol; // Sample pattern for pixel, lens, time and BSDF dimensions
+
+    bool   adaptive_sampling    = false;        // Stop sampling a pixel once its estimate converges
+    double adaptive_threshold   = 0.01;         // Converged when the display-space standard error drops below this
+    int    adaptive_min_samples = 16;           // Samples every pixel takes before convergence is tested
+    int    adaptive_max_samples = 0;            // Per-pixel sample cap for noisy pixels (0 = samples_per_pixel)
+
+    bool   russian_roulette = true;             // Randomly end low-throughput paths (unbiased)
+    int    rr_min_depth     = 5;                // Bounces before Russian roulette may end a path
+    bool   show_statistics  = true;             // Print path, timing and intersection statistics
+    std::string stats_filename;                 // Write the statistics as JSON here (empty = no report)
+    bool   next_event_estimation = true;        // Sample the lights directly at each diffuse hit
+    bool   wavefront      = false;              // Trace sorted batches of rays stage by stage instead of one path at a time
+    int    wavefront_size = 1 << 14;            // Paths in flight per wavefront batch
+    int    packet_size    = 0;                  // Trace camera rays in SIMD packets of 4, 8 or 16 (0 = off)
 
-    void render(const hittable& world) {
+    bool   write_aovs = false;                  // Also write first-hit albedo, normal and depth images (PFM)
+    bool   denoise    = false;                  // Run the AOV-guided denoiser over the final image
+    denoise_options denoising;                  // Denoiser filter settings
+    bool   write_cost_map = false;              // Also write per-pixel cost heatmaps and raw costs (per-pixel integrator only)
+
+    std::string checkpoint_filename;            // Accumulation file to checkpoint into (empty = no checkpoints)
+    double checkpoint_interval     = 300;       // Minimum seconds between checkpoint writes
+    int    checkpoint_pass_samples = 16;        // Samples per pixel rendered between checkpoint opportunities
+    bool   resume = false;                      // Continue from checkpoint_filename if it exists
+
+    void render(const hittable& world, const hittable_list& lights = hittable_list()) {
+        thread_pool pool(num_threads);
+        render(world, lights, pool);
+    }
+
+    void render(const hittable& world, thread_pool& pool) {
+        render(world, hittable_list(), pool);
+    }
+
+    // Renders on an existing pool, which other renders may be using at the same time. Tiles are
+    // queued at this camera's priority; the call returns once all of them are done. The lights
+    // are the emitters next-event estimation samples directly; leave it empty to rely on BSDF
+    // sampling alone.
+    void render(const hittable& world, const hittable_list& lights, thread_pool& pool) {
         initialize();
-        std::ofstream file(output_filename);
-        if (!file) {
-            std::cerr << "Could not open the file for writing.\n";
-            return;
-        }
+        auto counters_at_start = render_stats::snapshot();
+        auto render_start = std::chrono::steady_clock::now();
+
+        // Samples accumulate per pixel, so a render can stop after any pass, checkpoint, and
+        // later pick up where it left off.
+        accumulation_buffer accum(image_width, image_height);
+        if (resume && !checkpoint_filename.empty())
+            load_checkpoint(accum);
+        accum.seed = seed;
+
+        auto image = make_shared<framebuffer>(image_width, image_height);
+        auto tiles = tile_order();
+
+        std::unique_ptr<aov_buffer> aovs;
+        if (collect_aovs)
+            aovs = std::make_unique<aov_buffer>(image_width, image_height);
+        std::unique_ptr<cost_buffer> costs;
+        if (write_cost_map)
+            costs = std::make_unique<cost_buffer>(image_width, image_height);
+
+        if (stream_to_stdout)
+            encoder.stream(image, std::cout);
+
+        // Without checkpoints the whole render is one pass; with them it runs in passes of
+        // checkpoint_pass_samples, with a checkpoint written after a pass once the interval is up.
+        int target = adaptive_sampling ? max_samples : samples_per_pixel;
+        bool checkpointing = !checkpoint_filename.empty();
+        int pass_size = checkpointing ? std::max(1, checkpoint_pass_samples) : target;
+        int passes = (target + pass_size - 1) / pass_size;
+        auto last_checkpoint = std::chrono::steady_clock::now();
+        path_stats stats;
+        std::mutex stats_mutex;
+
+        for (int pass = 0; pass < passes; pass++) {
+            int sample_limit = std::min(target, (pass + 1) * pass_size);
+            bool final_pass = pass == passes - 1;
 
-        // Render
-        file << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-        for(int j = 0; j < image_height; j++) {
-            std::clog << "\rProgress: " << (double(j) / (image_height - 1)) * 100 << "% " << std::flush;
-            for(int i = 0; i < image_width; i++) {
-                color pixel_color(0,0,0);
-                for (int sample = 0; sample < samples_per_pixel; sample++) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
+            // Render tiles in parallel. Every tile owns a disjoint set of pixels, so the workers
+            // never need to synchronize on the buffers.
+            task_group group(priority);
+            std::atomic<int> tiles_done{0};
+
+            // Hand each worker a contiguous run of the curve so its tiles stay spatially
+            // coherent; stealing rebalances whatever is left over.
+            for (size_t k = 0; k < tiles.size(); k++) {
+                int worker = int(k * pool.size() / tiles.size());
+                auto tile = tiles[k];
+                auto tile_aovs = aovs.get();
+                auto tile_costs = costs.get();
+                pool.submit(group, [=, &world, &lights, &accum, &image, &tiles_done, &stats, &stats_mutex] {
+                    path_stats tile_stats;
+                    render_tile(world, lights, tile, accum, tile_aovs, tile_costs, *image,
+                                sample_limit, final_pass, tile_stats);
+                    {
+                        std::lock_guard<std::mutex> lock(stats_mutex);
+                        stats.merge(tile_stats);
+                    }
+                    tiles_done.fetch_add(1, std::memory_order_relaxed);
+                }, worker);
+            }
+
+            if (show_progress) {
+                while (!group.wait_for(std::chrono::milliseconds(250))) {
+                    double done = pass + double(tiles_done) / tiles.size();
+                    std::clog << "\rProgress: " << 100.0 * done / passes << "% " << std::flush;
                 }
-                write_color(file, pixel_samples_scale * pixel_color);
+            }
+            pool.wait(group);
+
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::duration<double> since_checkpoint = now - last_checkpoint;
+            if (checkpointing && (final_pass || since_checkpoint.count() >= checkpoint_interval)) {
+                if (!accum.save(checkpoint_filename))
+                    std::cerr << "Could not write checkpoint " << checkpoint_filename << ".\n";
+                last_checkpoint = now;
+            }
+        }
+
+        if (show_progress)
+            std::clog << "\rDone.                          \n";
+        std::chrono::duration<double> render_time = std::chrono::steady_clock::now() - render_start;
+        render_stats::phase_seconds(render_phase::render) += render_time.count();
+        if (adaptive_sampling)
+            report_sample_distribution(accum);
+
+        if (costs) {
+            std::clog << costs->summary();
+            write_cost_images(*costs);
+        }
+
+        if (aovs) {
+            if (write_aovs)
+                write_aov_images(*aovs);
+            if (denoise) {
+                // The noisy image is kept next to the AOVs for comparison.
+                if (write_aovs)
+                    encoder.encode(image, output_name("_noisy"));
+                render_stats::scoped_phase timing(render_phase::denoise);
+                auto denoised = make_shared<framebuffer>(image_width, image_height);
+                denoiser(denoising).run(accum, *aovs, *denoised, &pool);
+                image = denoised;
             }
         }
-        std::clog << "\rDone.                          \n";
-        file.close();
-        std::system(("open " + output_filename).c_str());
+
+        // Encoding happens on a background thread; the camera waits for it when it is destroyed
+        // or starts its next render.
+        auto filename = output_filename;
+        if (open_output) {
+            encoder.encode(image, filename, [filename] {
+                std::system(("open " + filename).c_str());
+            });
+        } else {
+            encoder.encode(image, filename);
+        }
+
+        // Counters are summed over the pool's threads, so renders sharing a pool also count
+        // each other's work. Phases are those of the calling thread, which are then reset for
+        // its next render.
+        render_report report;
+        report.output_filename = output_filename;
+        report.image_width = image_width;
+        report.image_height = image_height;
+        report.samples_per_pixel = samples_per_pixel;
+        report.paths = stats;
+        report.counters = render_stats::difference(render_stats::snapshot(), counters_at_start);
+        for (int k = 0; k < render_stats::phase_count; k++)
+            report.phases[k] = render_stats::phase_seconds(render_phase(k));
+
+        if (show_statistics)
+            std::clog << stats.summary() << report.summary();
+        if (!stats_filename.empty()) {
+            // Wait for the encoder so the report includes the output time.
+            {
+                render_stats::scoped_phase timing(render_phase::output);
+                encoder.wait();
+            }
+            for (int k = 0; k < render_stats::phase_count; k++)
+                report.phases[k] = render_stats::phase_seconds(render_phase(k));
+            std::ofstream out(stats_filename);
+            out << report.json();
+            if (!out)
+                std::cerr << "Could not write statistics to " << stats_filename << ".\n";
+        }
+        render_stats::reset_phases();
+        report_of_last_render = report;
     }
 
+    // Statistics of the most recent render, as printed and written to stats_filename.
+    const render_report& last_report() const { return report_of_last_render; }
+
   private:
     int    image_height;        // Rendered image height
-    double pixel_samples_scale; // Color scale factor for a sum of pixel samples
+    int    min_samples;         // Adaptive sampling: samples before convergence is tested
+    int    max_samples;         // Adaptive sampling: per-pixel sample cap
+    bool   collect_aovs;        // Record first-hit AOVs (for write_aovs or denoise)
     double reflectance = 0.5;   // Surface reflectance factor
     point3 center;              // Camera center
     point3 pixel00_loc;         // Location of pixel 0, 0
@@ -59,10 +247,20 @@ class camera {
     vec3   defocus_disk_u;      // Defocus disk horizontal radius
     vec3   defocus_disk_v;      // Defocus disk vertical radius
 
+    image_encoder encoder;      // Background writer for finished framebuffers
+    render_report report_of_last_render;
+
     void initialize() {
+        encoder.wait();
         image_height = int(image_width / aspect_ratio);
         image_height = (image_height < 1) ? 1 : image_height;
-        pixel_samples_scale = 1.0 / samples_per_pixel;
+        min_samples = std::max(1, std::min(adaptive_min_samples, samples_per_pixel));
+        // By default no pixel takes more than a fixed render would, so adaptive sampling only
+        // ever saves samples. A higher cap lets noisy pixels spend what flat ones saved, and
+        // more: the total is not capped.
+        max_samples = adaptive_max_samples > 0 ? adaptive_max_samples : samples_per_pixel;
+        max_samples = std::max(max_samples, min_samples);
+        collect_aovs = write_aovs || denoise;
         center = lookfrom;
        
         // Determine viewport dimensions.
@@ -94,49 +292,561 @@ class camera {
         defocus_disk_v = v * defocus_radius;
     }
 
-    ray get_ray(int i, int j) const {
-        auto offset = sample_square();
+    struct tile {
+        int x0, y0, x1, y1;   // Pixel bounds, half-open
+    };
+
+    // Splits the image into tiles and orders them along a Hilbert curve, so consecutive tiles
+    // (and therefore the tiles one worker renders back to back) touch neighbouring parts of the
+    // scene.
+    std::vector<tile> tile_order() const {
+        int size = std::max(1, tile_size);
+        int tiles_x = (image_width + size - 1) / size;
+        int tiles_y = (image_height + size - 1) / size;
+
+        int n = 1;
+        while (n < tiles_x || n < tiles_y)
+            n *= 2;
+
+        std::vector<tile> tiles;
+        tiles.reserve(size_t(tiles_x) * tiles_y);
+        for (long d = 0; d < long(n) * n; d++) {
+            int tx, ty;
+            hilbert_d2xy(n, d, tx, ty);
+            if (tx >= tiles_x || ty >= tiles_y)
+                continue;
+            tiles.push_back({tx * size, ty * size,
+                             std::min(image_width, (tx + 1) * size),
+                             std::min(image_height, (ty + 1) * size)});
+        }
+        return tiles;
+    }
+
+    static void hilbert_d2xy(int n, long d, int& x, int& y) {
+        // Converts a distance along a Hilbert curve filling an n x n grid (n a power of two) into
+        // grid coordinates.
+        x = y = 0;
+        for (long s = 1; s < n; s *= 2) {
+            int rx = 1 & int(d / 2);
+            int ry = 1 & int(d ^ rx);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = int(s) - 1 - x;
+                    y = int(s) - 1 - y;
+                }
+                std::swap(x, y);
+            }
+            x += int(s) * rx;
+            y += int(s) * ry;
+            d /= 4;
+        }
+    }
+
+    void render_tile(
+        const hittable& world, const hittable_list& lights, const tile& t,
+        accumulation_buffer& accum, aov_buffer* aovs, cost_buffer* costs, framebuffer& image,
+        int sample_limit, bool final_pass,
+        path_stats& stats
+    ) const {
+        auto smp = make_sampler(sampler_kind, samples_per_pixel, seed);
+        // Pixel costs can only be attributed when pixels are rendered one at a time.
+        bool per_pixel = costs || (!wavefront && packet_size <= 0);
+        if (!per_pixel && wavefront)
+            render_tile_wavefront(world, lights, t, accum, aovs, sample_limit, *smp, stats);
+        else if (!per_pixel)
+            render_tile_packets(world, lights, t, accum, aovs, sample_limit, *smp, stats);
+
+        for (int j = t.y0; j < t.y1; j++) {
+            for (int i = t.x0; i < t.x1; i++) {
+                if (per_pixel)
+                    sample_pixel(world, lights, i, j, accum, aovs, costs, sample_limit, *smp,
+                                 stats);
+                if (final_pass)
+                    image.set(i, j, accum.mean(i, j));
+            }
+            if (final_pass)
+                image.finish_pixels(j, t.x1 - t.x0);
+        }
+    }
+
+    void render_tile_wavefront(
+        const hittable& world, const hittable_list& lights, const tile& t,
+        accumulation_buffer& accum, aov_buffer* aovs, int sample_limit, sampler& smp,
+        path_stats& stats
+    ) const {
+        // Renders the tile's samples in rounds. Each round gives every unfinished pixel the
+        // samples up to its next convergence test (or all of them without adaptive sampling),
+        // and traces them in batches of up to wavefront_size paths.
+        struct sample_job { int i, j, n; };
+        std::vector<sample_job> jobs;
+        std::vector<wavefront_path> paths;
+        int batch_size = std::max(1, wavefront_size);
+
+        while (true) {
+            jobs.clear();
+            for (int j = t.y0; j < t.y1; j++) {
+                for (int i = t.x0; i < t.x1; i++) {
+                    int n = accum.samples(i, j);
+                    if (n >= sample_limit || (adaptive_sampling && converged(accum, i, j)))
+                        continue;
+                    int end = adaptive_sampling ? next_convergence_test(n) : sample_limit;
+                    for (end = std::min(end, sample_limit); n < end; n++)
+                        jobs.push_back({i, j, n});
+                }
+            }
+            if (jobs.empty())
+                return;
+
+            for (size_t first = 0; first < jobs.size(); first += batch_size) {
+                size_t count = std::min(jobs.size() - first, size_t(batch_size));
+                paths.resize(count);
+                for (size_t k = 0; k < count; k++) {
+                    const auto& job = jobs[first + k];
+                    auto& p = paths[k];
+                    p.i = job.i;
+                    p.j = job.j;
+                    p.n = job.n;
+                }
+                trace_wavefront(world, lights, paths, smp, stats);
+
+                // Samples are added in the same per-pixel order as the path-at-a-time
+                // integrator, so both produce identical images.
+                for (const auto& p : paths)
+                    add_sample(accum, aovs, p.i, p.j, p.state);
+            }
+
+            if (!adaptive_sampling)
+                return;
+        }
+    }
+
+    void render_tile_packets(
+        const hittable& world, const hittable_list& lights, const tile& t,
+        accumulation_buffer& accum, aov_buffer* aovs, int sample_limit, sampler& smp,
+        path_stats& stats
+    ) const {
+        // Walks the tile in small pixel blocks (2x2, 4x2 or 4x4) and traces each block's next
+        // camera rays as one packet: one ray per pixel that still needs samples. The packet
+        // only covers the primary hit; from there every path continues on its own. Each pixel
+        // still takes its samples in order with the same convergence tests, so the image
+        // matches the per-pixel integrator.
+        int block_w = packet_size >= 8 ? 4 : 2;
+        int block_h = packet_size >= 16 ? 4 : 2;
+        ray_packet packet;
+        hit_record recs[ray_packet::max_size];
+        int pixel_i[ray_packet::max_size], pixel_j[ray_packet::max_size];
+        int sample_n[ray_packet::max_size];
+
+        for (int by = t.y0; by < t.y1; by += block_h) {
+            for (int bx = t.x0; bx < t.x1; bx += block_w) {
+                while (true) {
+                    packet.clear();
+                    for (int j = by; j < std::min(by + block_h, t.y1); j++) {
+                        for (int i = bx; i < std::min(bx + block_w, t.x1); i++) {
+                            int n = accum.samples(i, j);
+                            if (n >= sample_limit || (adaptive_sampling && converged(accum, i, j)))
+                                continue;
+                            thread_rng().seed(seed, uint64_t(j) * image_width + i, n);
+                            smp.start_sample(i, j, n);
+                            int k = packet.add(get_ray(i, j, smp));
+                            packet.rng[k] = thread_rng();
+                            pixel_i[k] = i;
+                            pixel_j[k] = j;
+                            sample_n[k] = n;
+                        }
+                    }
+                    if (packet.size == 0)
+                        break;
+
+                    uint32_t hits = max_depth > 0 ? world.hit_packet(packet, packet.all(), recs) : 0;
+
+                    for (int k = 0; k < packet.size; k++) {
+                        thread_rng() = packet.rng[k];
+                        smp.start_sample(pixel_i[k], pixel_j[k], sample_n[k]);
+                        path_state path(packet.rays[k]);
+                        if (!reached_depth_limit(path, stats)
+                            && shade(path, (hits >> k) & 1, recs[k], world, lights, smp, stats))
+                            trace(path, world, lights, smp, stats);
+                        add_sample(accum, aovs, pixel_i[k], pixel_j[k], path);
+                    }
+                }
+            }
+        }
+    }
+
+    int next_convergence_test(int n) const {
+        // The sample count at which converged() next runs a test, for a pixel with n samples.
+        if (n < min_samples)
+            return min_samples;
+        return n + 4 - (n - min_samples) % 4;
+    }
+
+    void trace_wavefront(
+        const hittable& world, const hittable_list& lights, std::vector<wavefront_path>& paths,
+        sampler& smp, path_stats& stats
+    ) const {
+        // Traces a batch of paths stage by stage: generate every camera ray, then repeatedly
+        // intersect all live rays (sorted by origin and direction) and shade all hits (grouped by
+        // material), queueing the continuations for the next round. Each path keeps its own
+        // random stream, so the interleaving does not change what it draws.
+        auto bounds = world.bounding_box();
+        wavefront_queue active, next;
+
+        for (uint32_t k = 0; k < paths.size(); k++) {
+            auto& p = paths[k];
+            thread_rng().seed(seed, uint64_t(p.j) * image_width + p.i, p.n);
+            smp.start_sample(p.i, p.j, p.n);
+            p.state = path_state(get_ray(p.i, p.j, smp));
+            p.rng = thread_rng();
+            active.push(k);
+        }
+
+        while (!active.empty()) {
+            next.clear();
+            for (auto k : active.items)
+                if (!reached_depth_limit(paths[k].state, stats))
+                    next.push(k);
+            std::swap(active, next);
+
+            active.sort_by_ray(paths, bounds);
+            for (auto k : active.items) {
+                auto& p = paths[k];
+                thread_rng() = p.rng;
+                p.hit = world.hit(p.state.r, interval(0.001, infinity), p.rec);
+                p.rng = thread_rng();
+            }
+
+            active.sort_by_material(paths);
+            next.clear();
+            for (auto k : active.items) {
+                auto& p = paths[k];
+                thread_rng() = p.rng;
+                smp.start_sample(p.i, p.j, p.n);
+                if (shade(p.state, p.hit, p.rec, world, lights, smp, stats))
+                    next.push(k);
+                p.rng = thread_rng();
+            }
+            std::swap(active, next);
+        }
+    }
+
+    void sample_pixel(
+        const hittable& world, const hittable_list& lights, int i, int j,
+        accumulation_buffer& accum, aov_buffer* aovs, cost_buffer* costs, int sample_limit,
+        sampler& smp, path_stats& stats
+    ) const {
+        std::chrono::steady_clock::time_point start;
+        uint64_t nodes_before = 0, tests_before = 0;
+        if (costs) {
+            start = std::chrono::steady_clock::now();
+            nodes_before = render_stats::local_count(render_counter::bvh_nodes);
+            tests_before = primitive_tests();
+        }
+
+        // Sample n always draws from the stream for (seed, pixel, n), so the pixel comes out the
+        // same however the samples are split across passes or resumed runs.
+        auto pixel_index = uint64_t(j) * image_width + i;
+        for (int n = accum.samples(i, j); n < sample_limit; n++) {
+            if (adaptive_sampling && converged(accum, i, j))
+                break;
+            thread_rng().seed(seed, pixel_index, n);
+            smp.start_sample(i, j, n);
+            path_state path(get_ray(i, j, smp));
+            trace(path, world, lights, smp, stats);
+            add_sample(accum, aovs, i, j, path);
+        }
+
+        if (costs) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            auto nodes = render_stats::local_count(render_counter::bvh_nodes) - nodes_before;
+            costs->add(i, j, elapsed.count(), double(nodes), double(primitive_tests() - tests_before));
+        }
+    }
+
+    static uint64_t primitive_tests() {
+        // This thread's intersection tests against primitives of every type so far.
+        return render_stats::local_count(render_counter::sphere_tests)
+             + render_stats::local_count(render_counter::quad_tests)
+             + render_stats::local_count(render_counter::tri_tests)
+             + render_stats::local_count(render_counter::medium_tests);
+    }
+
+    static void add_sample(
+        accumulation_buffer& accum, aov_buffer* aovs, int i, int j, const path_state& path
+    ) {
+        accum.add_sample(i, j, path.radiance);
+        if (aovs)
+            aovs->add_sample(i, j, path.first_albedo, path.first_normal, path.first_depth);
+    }
+
+    // The output filename with suffix inserted before its extension, which extension replaces
+    // when given.
+    std::string output_name(const std::string& suffix, const std::string& extension = "") const {
+        auto dot = output_filename.find_last_of('.');
+        auto slash = output_filename.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = output_filename.size();
+        auto stem = output_filename.substr(0, dot);
+        return stem + suffix + (extension.empty() ? output_filename.substr(dot) : extension);
+    }
+
+    void write_aov_images(const aov_buffer& aovs) {
+        auto albedo = make_shared<framebuffer>(image_width, image_height);
+        auto normal = make_shared<framebuffer>(image_width, image_height);
+        auto depth = make_shared<framebuffer>(image_width, image_height);
+        aovs.resolve(*albedo, *normal, *depth);
+        encoder.encode(albedo, output_name("_albedo", ".pfm"));
+        encoder.encode(normal, output_name("_normal", ".pfm"));
+        encoder.encode(depth, output_name("_depth", ".pfm"));
+    }
+
+    void write_cost_images(const cost_buffer& costs) {
+        // Heatmaps in the output's format, or PNG when that is PFM: they hold display colours
+        // for a gamma-encoding writer. Every metric goes unscaled into one PFM as well.
+        bool linear_output = image_format_for(output_filename) == image_format::pfm;
+        auto write_heatmap = [&](cost_buffer::metric m, const std::string& suffix) {
+            auto image = make_shared<framebuffer>(image_width, image_height);
+            costs.heatmap(m, *image);
+            encoder.encode(image, output_name(suffix, linear_output ? ".png" : ""));
+        };
+        write_heatmap(cost_buffer::seconds, "_cost_time");
+        if (render_stats::counters_enabled) {
+            write_heatmap(cost_buffer::bvh_nodes, "_cost_nodes");
+            write_heatmap(cost_buffer::primitive_tests, "_cost_tests");
+        }
+
+        auto raw = make_shared<framebuffer>(image_width, image_height);
+        costs.resolve(*raw);
+        encoder.encode(raw, output_name("_cost", ".pfm"));
+    }
+
+    bool converged(const accumulation_buffer& accum, int i, int j) const {
+        // Adaptive sampling stops a pixel once the standard error of its mean luminance, mapped
+        // through the sqrt display gamma, is below adaptive_threshold. The test runs every 4
+        // samples after min_samples. Flat pixels stop early; noisy ones keep going up to
+        // max_samples, so the samples go where the noise is.
+        int n = accum.samples(i, j);
+        if (n < min_samples || (n - min_samples) % 4 != 0)
+            return false;
+
+        double mean = accumulation_buffer::luminance(accum.mean(i, j));
+        double display_slope = 0.5 / std::sqrt(std::fmax(mean, 1.0 / 255.0));
+        return accum.standard_error(i, j) * display_slope < adaptive_threshold;
+    }
+
+    void load_checkpoint(accumulation_buffer& accum) {
+        accumulation_buffer saved;
+        if (!saved.load(checkpoint_filename)) {
+            std::clog << "No checkpoint at " << checkpoint_filename << ", starting fresh.\n";
+            return;
+        }
+        if (saved.width() != image_width || saved.height() != image_height) {
+            std::cerr << "Checkpoint " << checkpoint_filename << " is " << saved.width() << 'x'
+                      << saved.height() << ", not " << image_width << 'x' << image_height
+                      << "; starting fresh.\n";
+            return;
+        }
+
+        // Continue the checkpoint's random streams, so the resumed render matches an
+        // uninterrupted one.
+        seed = saved.seed;
+        accum = std::move(saved);
+        std::clog << "Resuming from " << checkpoint_filename << " with "
+                  << double(accum.total_samples()) / (double(image_width) * image_height)
+                  << " samples/pixel.\n";
+    }
+
+    void report_sample_distribution(const accumulation_buffer& accum) const {
+        // Buckets pixels by sample count in powers of two and compares the total against what a
+        // fixed samples_per_pixel render would have spent.
+        long long total = 0;
+        std::vector<long long> buckets;
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                int count = accum.samples(i, j);
+                total += count;
+                size_t b = 0;
+                while ((2 << b) <= count) b++;
+                if (buckets.size() <= b) buckets.resize(b + 1);
+                buckets[b]++;
+            }
+        }
+
+        auto pixels = double(image_width) * image_height;
+        auto baseline = double(samples_per_pixel) * pixels;
+        std::clog << "Adaptive sampling: " << total / pixels << " samples/pixel on average, "
+                  << 100.0 * total / baseline << "% of the fixed " << samples_per_pixel
+                  << " spp budget\n";
+        for (size_t b = 0; b < buckets.size(); b++) {
+            if (buckets[b] == 0) continue;
+            std::clog << "  " << (1 << b) << '-' << (2 << b) - 1 << " spp: "
+                      << 100.0 * buckets[b] / pixels << "% of pixels\n";
+        }
+    }
+
+    // Sampler dimensions used by the camera (pixel 2, lens 2, time 1) and by each bounce after it.
+    static const int camera_dimensions = 5;
+    static const int bounce_dimensions = 3;
+
+    ray get_ray(int i, int j, sampler& smp) const {
+        // The lens dimensions are drawn even without defocus, so time and the bounces always
+        // read the same dimensions.
+        auto offset = sample_square(smp);
+        auto lens = smp.get_2d();
         auto pixel_sample = pixel00_loc + ((i + offset.x()) * pixel_delta_u) + ((j + offset.y()) * pixel_delta_v);
-        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample(lens);
         auto ray_direction = pixel_sample - ray_origin;
-        auto ray_time = random_double();
+        auto ray_time = smp.get_1d();
         return ray(ray_origin, ray_direction, ray_time);
     }
 
-    vec3 sample_square() const {
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+    vec3 sample_square(sampler& smp) const {
+        auto s = smp.get_2d();
+        return vec3(s.u - 0.5, s.v - 0.5, 0);
     }
 
-    point3 defocus_disk_sample() const {
-        auto p = random_in_unit_disk();
+    point3 defocus_disk_sample(const sample2& s) const {
+        auto p = sample_disk(s.u, s.v);
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world) const {
-    // If we've exceeded the ray bounce limit, no more light is gathered.
-    if (depth <= 0)
-        return color(0,0,0);
+    color ray_color(
+        const ray& r_in, const hittable& world, const hittable_list& lights, sampler& smp,
+        path_stats& stats
+    ) const {
+        path_state path(r_in);
+        trace(path, world, lights, smp, stats);
+        return path.radiance;
+    }
+
+    void trace(
+        path_state& path, const hittable& world, const hittable_list& lights, sampler& smp,
+        path_stats& stats
+    ) const {
+        // Follows a path bounce by bounce until it ends.
+        hit_record rec;
+        while (!reached_depth_limit(path, stats)) {
+            bool hit = world.hit(path.r, interval(0.001, infinity), rec);
+            if (!shade(path, hit, rec, world, lights, smp, stats))
+                break;
+        }
+    }
+
+    bool reached_depth_limit(const path_state& path, path_stats& stats) const {
+        // If we've exceeded the ray bounce limit, no more light is gathered.
+        if (path.depth < max_depth)
+            return false;
+        stats.record(path.depth, path_stats::depth_limit);
+        return true;
+    }
+
+    bool shade(
+        path_state& path, bool hit, const hit_record& rec, const hittable& world,
+        const hittable_list& lights, sampler& smp, path_stats& stats
+    ) const {
+        // Advances a path by one bounce, given the result of intersecting its current ray.
+        // Returns false once the path has ended. The path carries the product of the BSDF
+        // weights so far as its throughput. After rr_min_depth bounces, Russian roulette ends the
+        // path with probability 1 - p, where p follows the throughput, and divides survivors by
+        // p, which keeps the estimate unbiased while dim paths stop early.
+        //
+        // With next-event estimation, every non-specular hit also samples a point on the lights
+        // and traces a shadow ray to it. Both that sample and the BSDF-sampled continuation can
+        // find the same light, so each is weighted by the power heuristic over the two pdfs.
+        const ray& r = path.r;
+        int depth = path.depth;
+        bool use_nee = next_event_estimation && !lights.objects.empty();
+
+        if (depth == 0 && collect_aovs) {
+            if (hit) {
+                path.first_albedo = rec.mat->surface_albedo(rec);
+                path.first_normal = rec.normal;
+                path.first_depth = rec.t * r.direction().length();
+            } else {
+                path.first_albedo = background;
+            }
+        }
+
+        // If the ray hits nothing, add the background color.
+        if (!hit) {
+            stats.record(depth + 1, path_stats::missed);
+            path.radiance += path.throughput * background;
+            return false;
+        }
+
+        ray scattered;
+        color attenuation;
+        color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
+        if (use_nee && path.bsdf_pdf > 0 && !color_from_emission.near_zero()) {
+            double light_pdf = lights.pdf_value(r.origin(), r.direction());
+            color_from_emission *= power_heuristic(path.bsdf_pdf, light_pdf);
+        }
+        path.radiance += path.throughput * color_from_emission;
+
+        smp.set_dimension(camera_dimensions + depth * bounce_dimensions);
+        if (!rec.mat->scatter(r, rec, attenuation, scattered, smp)) {
+            stats.record(depth + 1, path_stats::absorbed);
+            return false;
+        }
 
-    hit_record rec;
-    // If the ray hits nothing, return the background color.
-    if (!world.hit(r, interval(0.001, infinity), rec))
-        return background;
+        // A zero pdf marks a specular (delta) scatter, whose weight is the attenuation alone.
+        double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+        double pdf_value = scattering_pdf;
 
-    ray scattered;
-    color attenuation;
-    color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
+        if (use_nee && pdf_value > 0)
+            path.radiance += path.throughput * sample_light(r, rec, attenuation, world, lights, stats);
 
-    if (!rec.mat->scatter(r, rec, attenuation, scattered))
-        return color_from_emission;
+        if (pdf_value > 0)
+            path.throughput = path.throughput * attenuation * scattering_pdf / pdf_value;
+        else
+            path.throughput = path.throughput * attenuation;
+        path.bsdf_pdf = pdf_value;
 
-    double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
-    double pdf_value = scattering_pdf;
+        if (russian_roulette && depth + 1 >= rr_min_depth) {
+            const color& t = path.throughput;
+            double survival = std::fmin(0.95, std::fmax(t.x(), std::fmax(t.y(), t.z())));
+            if (random_double() >= survival) {
+                stats.record(depth + 1, path_stats::roulette);
+                return false;
+            }
+            path.throughput /= survival;
+        }
+
+        path.r = scattered;
+        path.depth++;
+        return true;
+    }
 
-    color color_from_scatter =
-        (attenuation * scattering_pdf * ray_color(scattered, depth-1, world)) / pdf_value;
+    color sample_light(
+        const ray& r, const hit_record& rec, const color& attenuation, const hittable& world,
+        const hittable_list& lights, path_stats& stats
+    ) const {
+        // One MIS-weighted light sample: radiance arriving along a direction picked by the lights'
+        // own sampling, times the BSDF (attenuation * scattering_pdf) over the light pdf.
+        ray shadow(rec.p, lights.random(rec.p), r.time());
+        double light_pdf = lights.pdf_value(shadow.origin(), shadow.direction());
+        if (light_pdf <= 0)
+            return color(0,0,0);
+
+        double scattering_pdf = rec.mat->scattering_pdf(r, rec, shadow);
+        if (scattering_pdf <= 0)
+            return color(0,0,0);
+
+        stats.shadow_rays++;
+        hit_record light_rec;
+        if (!world.hit(shadow, interval(0.001, infinity), light_rec))
+            return color(0,0,0);
+
+        color emitted = light_rec.mat->emitted(light_rec.u, light_rec.v, light_rec.p);
+        double weight = power_heuristic(light_pdf, scattering_pdf);
+        return attenuation * scattering_pdf * emitted * (weight / light_pdf);
+    }
 
-    return color_from_emission + color_from_scatter;
+    static double power_heuristic(double pdf, double other_pdf) {
+        auto a = pdf * pdf;
+        auto b = other_pdf * other_pdf;
+        return a / (a + b);
     }
 };
 
-#endif
\ No newline at end of file
+#endif
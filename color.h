@@ -22,22 +22,17 @@ inline color hexConvert(int hexValue) {
     return color(r, g, b);
 }
 
-void write_color(std::ostream& out, const color& pixel_color){
-    auto r = pixel_color.x();
-    auto g = pixel_color.y();
-    auto b = pixel_color.z();
+inline int linear_to_byte(double linear_component) {
+    // Apply gamma correction, clamp to [0.0,0.999] and convert to byte [0,255]
+    static const interval intesety(0.0, 0.999);
+    return int(255.99 * intesety.clamp(linear_to_gamma(linear_component)));
+}
 
-    // Apply gamma correction
-    r = linear_to_gamma(r);
-    g = linear_to_gamma(g);
-    b = linear_to_gamma(b);
+void write_color(std::ostream& out, const color& pixel_color){
+    int rbyte = linear_to_byte(pixel_color.x());
+    int gbyte = linear_to_byte(pixel_color.y());
+    int bbyte = linear_to_byte(pixel_color.z());
 
-    // Clamp to [0.0,0.999] and convert to byte [0,255]
-    static const interval intesety(0.0, 0.999);
-    int rbyte = int(255.99 * intesety.clamp(r));
-    int gbyte = int(255.99 * intesety.clamp(g));
-    int bbyte = int(255.99 * intesety.clamp(b));
-    
     out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
 }
 #endif
@@ -18,6 +18,7 @@ class constant_medium : public hittable {
     {}
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_STAT(medium_tests);
         hit_record rec1, rec2;
 
         if (!boundary->hit(r, interval::universe, rec1))
@@ -37,6 +38,7 @@ class constant_medium : public hittable {
 
         auto ray_length = r.direction().length();
         auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
+        RT_STAT(medium_samples);
         auto hit_distance = neg_inv_density * std::log(random_double());
 
         if (hit_distance > distance_inside_boundary)
@@ -47,8 +49,9 @@ class constant_medium : public hittable {
 
         rec.normal = vec3(1,0,0); 
         rec.front_face = true;     
-        rec.mat = phase_function;
+        rec.mat = phase_function.get();
 
+        RT_STAT(medium_hits);
         return true;
     }
 
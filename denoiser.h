@@ -0,0 +1,255 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "rtweekend.h"
+#include "accumulation.h"
+#include "framebuffer.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <vector>
+
+// First-hit auxiliary outputs (AOVs) averaged over each pixel's samples: surface albedo, shading
+// normal and distance from the camera. They are nearly noise-free at low sample counts and mark
+// the edges that a denoiser must not blur across.
+class aov_buffer {
+  public:
+    aov_buffer(int width, int height)
+      : image_width(width), image_height(height), pixels(size_t(width) * height) {}
+
+    int width() const  { return image_width; }
+    int height() const { return image_height; }
+
+    void add_sample(int i, int j, const color& albedo, const vec3& normal, double depth) {
+        auto& p = at(i, j);
+        p.albedo += albedo;
+        p.normal += normal;
+        p.count++;
+        if (depth < infinity) {
+            p.depth += depth;
+            p.depth_count++;
+        }
+    }
+
+    color albedo(int i, int j) const {
+        const auto& p = at(i, j);
+        return p.count > 0 ? p.albedo / p.count : color(0,0,0);
+    }
+
+    vec3 normal(int i, int j) const {
+        auto n = at(i, j).normal;
+        return n.near_zero() ? vec3(0,0,0) : unit_vector(n);
+    }
+
+    // Mean distance of the samples that hit something; infinity if none did.
+    double depth(int i, int j) const {
+        const auto& p = at(i, j);
+        return p.depth_count > 0 ? p.depth / p.depth_count : infinity;
+    }
+
+    // Copies the buffers into images for writing out. Depth goes into all three channels, with
+    // misses written as 0.
+    void resolve(framebuffer& albedo_image, framebuffer& normal_image, framebuffer& depth_image)
+    const {
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                albedo_image.set(i, j, albedo(i, j));
+                normal_image.set(i, j, normal(i, j));
+                double d = depth(i, j);
+                d = d < infinity ? d : 0;
+                depth_image.set(i, j, color(d, d, d));
+            }
+        }
+    }
+
+  private:
+    struct pixel {
+        color albedo;
+        vec3 normal;
+        double depth = 0;
+        uint32_t count = 0;
+        uint32_t depth_count = 0;
+    };
+
+    int image_width;
+    int image_height;
+    std::vector<pixel> pixels;
+
+    pixel& at(int i, int j) { return pixels[size_t(j) * image_width + i]; }
+    const pixel& at(int i, int j) const { return pixels[size_t(j) * image_width + i]; }
+};
+
+struct denoise_options {
+    int    iterations   = 5;        // A-trous passes; the filter footprint doubles with each one
+    double sigma_color  = 4.0;      // Luminance tolerance, in standard deviations of the noise
+    double sigma_normal = 128.0;    // Exponent on the cosine between normals
+    double sigma_depth  = 1.0;      // Depth tolerance, relative to the local depth gradient
+};
+
+// Edge-avoiding a-trous wavelet filter guided by the AOVs (Dammertz et al. 2010), with the
+// luminance weight scaled by each pixel's estimated noise as in SVGF (Schied et al. 2017).
+// Colour is first divided by albedo, so texture detail is not smoothed away, and multiplied back
+// after filtering. Rows are split across the pool when one is given.
+class denoiser {
+  public:
+    denoiser(const denoise_options& options = denoise_options()) : options(options) {}
+
+    void run(const accumulation_buffer& accum, const aov_buffer& aovs, framebuffer& out,
+             thread_pool* pool = nullptr) const {
+        int w = accum.width(), h = accum.height();
+        std::vector<pixel> current(size_t(w) * h), next(current.size());
+        std::vector<guide> guides(current.size());
+
+        for (int j = 0; j < h; j++) {
+            for (int i = 0; i < w; i++) {
+                auto& g = guides[size_t(j) * w + i];
+                auto albedo = aovs.albedo(i, j);
+                g.demodulate = color(albedo.x() > 0.001 ? albedo.x() : 1,
+                                     albedo.y() > 0.001 ? albedo.y() : 1,
+                                     albedo.z() > 0.001 ? albedo.z() : 1);
+                g.normal = aovs.normal(i, j);
+                g.depth = aovs.depth(i, j);
+
+                auto& p = current[size_t(j) * w + i];
+                auto c = accum.mean(i, j);
+                p.c = color(c.x() / g.demodulate.x(), c.y() / g.demodulate.y(),
+                            c.z() / g.demodulate.z());
+                double scale = accumulation_buffer::luminance(g.demodulate);
+                double error = accum.standard_error(i, j) / scale;
+                p.variance = std::isinf(error) ? 1e6 : error * error;
+            }
+        }
+        for (int j = 0; j < h; j++)
+            for (int i = 0; i < w; i++)
+                guides[size_t(j) * w + i].depth_gradient = depth_gradient(guides, w, h, i, j);
+
+        for (int pass = 0; pass < options.iterations; pass++) {
+            int step = 1 << pass;
+            for_rows(h, pool, [&](int j) {
+                for (int i = 0; i < w; i++)
+                    next[size_t(j) * w + i] = filter(current, guides, w, h, i, j, step);
+            });
+            std::swap(current, next);
+        }
+
+        for (int j = 0; j < h; j++)
+            for (int i = 0; i < w; i++)
+                out.set(i, j, current[size_t(j) * w + i].c * guides[size_t(j) * w + i].demodulate);
+    }
+
+  private:
+    struct pixel {
+        color c;                // Demodulated colour
+        double variance;        // Estimated variance of its luminance
+    };
+
+    struct guide {
+        color demodulate;
+        vec3 normal;
+        double depth;
+        double depth_gradient;  // Largest depth change to a neighbouring pixel
+    };
+
+    denoise_options options;
+
+    template <typename Row>
+    static void for_rows(int height, thread_pool* pool, Row row) {
+        if (!pool) {
+            for (int j = 0; j < height; j++)
+                row(j);
+            return;
+        }
+        task_group group;
+        int chunk = std::max(1, height / (4 * pool->size()));
+        for (int j0 = 0; j0 < height; j0 += chunk) {
+            int j1 = std::min(height, j0 + chunk);
+            pool->submit(group, [=] {
+                for (int j = j0; j < j1; j++)
+                    row(j);
+            });
+        }
+        pool->wait(group);
+    }
+
+    static double depth_gradient(const std::vector<guide>& guides, int w, int h, int i, int j) {
+        double z = guides[size_t(j) * w + i].depth;
+        double gradient = 0;
+        const int dx[4] = {1, -1, 0, 0}, dy[4] = {0, 0, 1, -1};
+        for (int k = 0; k < 4; k++) {
+            int x = i + dx[k], y = j + dy[k];
+            if (x < 0 || x >= w || y < 0 || y >= h) continue;
+            double neighbour = guides[size_t(y) * w + x].depth;
+            if (z < infinity && neighbour < infinity)
+                gradient = std::fmax(gradient, std::fabs(neighbour - z));
+        }
+        return gradient;
+    }
+
+    double blurred_variance(const std::vector<pixel>& in, int w, int h, int i, int j) const {
+        // A 3x3 Gaussian over the variance steadies the luminance weight at low sample counts.
+        const double kernel[2] = {0.25, 0.125};
+        double sum = 0, weight = 0;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int x = i + dx, y = j + dy;
+                if (x < 0 || x >= w || y < 0 || y >= h) continue;
+                double k = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+                sum += k * in[size_t(y) * w + x].variance;
+                weight += k;
+            }
+        }
+        return sum / weight;
+    }
+
+    pixel filter(const std::vector<pixel>& in, const std::vector<guide>& guides, int w, int h,
+                 int i, int j, int step) const {
+        // B3-spline taps spaced step pixels apart, each weighted by how closely the neighbour's
+        // luminance, normal and depth match the centre pixel's.
+        const double kernel[3] = {3.0 / 8, 1.0 / 4, 1.0 / 16};
+
+        const auto& centre = in[size_t(j) * w + i];
+        const auto& g = guides[size_t(j) * w + i];
+        double lum = accumulation_buffer::luminance(centre.c);
+        double lum_scale = options.sigma_color * std::sqrt(blurred_variance(in, w, h, i, j)) + 1e-10;
+
+        color sum(0,0,0);
+        double variance = 0, weight_sum = 0;
+        for (int ty = -2; ty <= 2; ty++) {
+            for (int tx = -2; tx <= 2; tx++) {
+                int x = i + tx * step, y = j + ty * step;
+                if (x < 0 || x >= w || y < 0 || y >= h) continue;
+                const auto& q = in[size_t(y) * w + x];
+                const auto& qg = guides[size_t(y) * w + x];
+
+                double weight = kernel[std::abs(tx)] * kernel[std::abs(ty)];
+                if (tx != 0 || ty != 0) {
+                    double lum_diff = std::fabs(accumulation_buffer::luminance(q.c) - lum);
+                    double w_color = std::exp(-lum_diff / lum_scale);
+
+                    double w_normal = 1;
+                    if (!g.normal.near_zero() || !qg.normal.near_zero())
+                        w_normal = std::pow(std::fmax(0.0, dot(g.normal, qg.normal)),
+                                            options.sigma_normal);
+
+                    double w_depth;
+                    if (g.depth == infinity || qg.depth == infinity) {
+                        w_depth = (g.depth == qg.depth) ? 1 : 0;
+                    } else {
+                        double distance = step * std::sqrt(double(tx*tx + ty*ty));
+                        double tolerance = options.sigma_depth * g.depth_gradient * distance + 1e-6;
+                        w_depth = std::exp(-std::fabs(g.depth - qg.depth) / tolerance);
+                    }
+
+                    weight *= w_color * w_normal * w_depth;
+                }
+
+                sum += weight * q.c;
+                variance += weight * weight * q.variance;
+                weight_sum += weight;
+            }
+        }
+
+        return {sum / weight_sum, variance / (weight_sum * weight_sum)};
+    }
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "rtweekend.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Linear (pre-gamma) RGB image held in memory as 32-bit floats, written by the render workers and
+// read by the image encoders. It also tracks how many pixels of each row are finished, so a
+// streaming encoder can emit rows in order while tiles are still completing elsewhere.
+class framebuffer {
+  public:
+    framebuffer(int width, int height)
+      : image_width(width), image_height(height),
+        pixels(size_t(width) * height * 3, 0.0f),
+        row_pixels_done(new std::atomic<int>[height])
+    {
+        for (int j = 0; j < height; j++)
+            row_pixels_done[j].store(0, std::memory_order_relaxed);
+    }
+
+    int width() const  { return image_width; }
+    int height() const { return image_height; }
+
+    void set(int i, int j, const color& c) {
+        auto p = &pixels[(size_t(j) * image_width + i) * 3];
+        p[0] = float(c.x());
+        p[1] = float(c.y());
+        p[2] = float(c.z());
+    }
+
+    color get(int i, int j) const {
+        auto p = &pixels[(size_t(j) * image_width + i) * 3];
+        return color(p[0], p[1], p[2]);
+    }
+
+    // Interleaved RGB floats for row j, left to right.
+    const float* row(int j) const { return &pixels[size_t(j) * image_width * 3]; }
+
+    // Records that count more pixels of row j have been written.
+    void finish_pixels(int j, int count) {
+        if (row_pixels_done[j].fetch_add(count, std::memory_order_acq_rel) + count == image_width) {
+            std::lock_guard<std::mutex> lock(row_mutex);
+            row_finished.notify_all();
+        }
+    }
+
+    bool row_done(int j) const {
+        return row_pixels_done[j].load(std::memory_order_acquire) >= image_width;
+    }
+
+    // Blocks until every pixel of row j has been written.
+    void wait_for_row(int j) const {
+        std::unique_lock<std::mutex> lock(row_mutex);
+        row_finished.wait(lock, [this, j] { return row_done(j); });
+    }
+
+  private:
+    int image_width;
+    int image_height;
+    std::vector<float> pixels;
+    std::unique_ptr<std::atomic<int>[]> row_pixels_done;
+    mutable std::mutex row_mutex;
+    mutable std::condition_variable row_finished;
+};
+
+#endif
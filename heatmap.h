@@ -0,0 +1,114 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "rtweekend.h"
+#include "framebuffer.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Per-pixel render cost: wall time spent sampling the pixel, and (in RT_STATS builds) the BVH
+// nodes visited and primitives tested on its behalf. Each pixel belongs to one tile, so workers
+// write it without synchronization.
+class cost_buffer {
+  public:
+    enum metric { seconds, bvh_nodes, primitive_tests, metric_count };
+
+    cost_buffer(int width, int height)
+      : image_width(width), image_height(height), values(size_t(width) * height * metric_count) {}
+
+    int width() const  { return image_width; }
+    int height() const { return image_height; }
+
+    void add(int i, int j, double time, double nodes, double tests) {
+        auto p = &values[(size_t(j) * image_width + i) * metric_count];
+        p[seconds] += time;
+        p[bvh_nodes] += nodes;
+        p[primitive_tests] += tests;
+    }
+
+    double get(int i, int j, metric m) const {
+        return values[(size_t(j) * image_width + i) * metric_count + m];
+    }
+
+    // Raw values, one metric per channel: seconds, nodes, tests.
+    void resolve(framebuffer& raw) const {
+        for (int j = 0; j < image_height; j++)
+            for (int i = 0; i < image_width; i++)
+                raw.set(i, j, color(get(i, j, seconds), get(i, j, bvh_nodes),
+                                    get(i, j, primitive_tests)));
+    }
+
+    // Colour-maps one metric on a log scale between its 1st and 99.5th percentiles, so a few
+    // extreme pixels don't flatten the rest of the map.
+    void heatmap(metric m, framebuffer& image) const {
+        std::vector<double> sorted;
+        sorted.reserve(size_t(image_width) * image_height);
+        for (int j = 0; j < image_height; j++)
+            for (int i = 0; i < image_width; i++)
+                if (get(i, j, m) > 0) sorted.push_back(get(i, j, m));
+        std::sort(sorted.begin(), sorted.end());
+
+        double lo = 1, hi = 1;
+        if (!sorted.empty()) {
+            lo = sorted[size_t(0.01 * (sorted.size() - 1))];
+            hi = sorted[size_t(0.995 * (sorted.size() - 1))];
+        }
+        double range = std::log(std::fmax(hi / lo, 1.0 + 1e-9));
+
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                double v = get(i, j, m);
+                double t = v > 0 ? std::log(std::fmax(v, lo) / lo) / range : 0;
+                auto c = ramp(std::fmin(t, 1.0));
+                // For the 8-bit writers only, which gamma-encode: store the square of the
+                // display colour.
+                image.set(i, j, c * c);
+            }
+        }
+    }
+
+    // One line naming the average and the most expensive pixel.
+    std::string summary() const {
+        double total = 0, worst = 0;
+        int worst_i = 0, worst_j = 0;
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                double t = get(i, j, seconds);
+                total += t;
+                if (t > worst) {
+                    worst = t;
+                    worst_i = i;
+                    worst_j = j;
+                }
+            }
+        }
+        double mean = total / (double(image_width) * image_height);
+        std::ostringstream out;
+        out << "Pixel cost: mean " << 1e3 * mean << " ms, max " << 1e3 * worst << " ms at ("
+            << worst_i << ", " << worst_j << "), " << worst / std::fmax(mean, 1e-12)
+            << "x the mean\n";
+        return out.str();
+    }
+
+  private:
+    int image_width;
+    int image_height;
+    std::vector<double> values;
+
+    static color ramp(double t) {
+        // Black through purple, red and orange to pale yellow, close to matplotlib's inferno.
+        static const color stops[] = {
+            color(0.00, 0.00, 0.02), color(0.34, 0.06, 0.43), color(0.73, 0.21, 0.33),
+            color(0.98, 0.55, 0.04), color(0.99, 1.00, 0.64)
+        };
+        const int segments = 4;
+        double x = t * segments;
+        int k = std::min(int(x), segments - 1);
+        double f = x - k;
+        return (1 - f) * stops[k] + f * stops[k + 1];
+    }
+};
+
+#endif
@@ -3,6 +3,8 @@
 
 #include "rtweekend.h"
 #include "AABB.h"
+#include "ray_packet.h"
+#include "transform.h"
 
 class material;
 
@@ -10,7 +12,7 @@ class hit_record {
     public:
         point3 p;
         vec3 normal;
-        shared_ptr<material> mat;
+        const material* mat;
         double t;
         double u;
         double v;
@@ -28,116 +30,116 @@ class hittable {
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
     virtual aabb bounding_box() const = 0;
-};
-
-class translate : public hittable {
-  public:
-    translate(shared_ptr<hittable> object, const vec3& offset)
-        : object(object), offset(offset)
-        {
-            bbox = object->bounding_box() + offset;
-        }
-        
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // Move the ray backwards by the offset
-        ray offset_r(r.origin() - offset, r.direction(), r.time());
-
-        // Determine whether an intersection exists along the offset ray (and if so, where)
-        if (!object->hit(offset_r, ray_t, rec))
-            return false;
 
-        // Move the intersection point forwards by the offset
-        rec.p += offset;
+    // The object's bounds at shutter open (time 0) and close (time 1), for motion BVHs, which
+    // interpolate between them and so rely on the object moving linearly. The default, the
+    // bounds over the whole shutter at both times, suits any object.
+    virtual void motion_bounds(aabb& open, aabb& close) const {
+        open = close = bounding_box();
+    }
 
-        return true;
+    // Light sampling hooks: the solid-angle density with which random(origin) picks direction
+    // from origin toward this object. Only shapes that can be emitters implement them.
+    virtual double pdf_value(const point3& origin, const vec3& direction) const {
+        return 0.0;
     }
 
-    aabb bounding_box() const override { return bbox; }
+    virtual vec3 random(const point3& origin) const {
+        return vec3(1,0,0);
+    }
 
-  private:
-    shared_ptr<hittable> object;
-    vec3 offset;
-    aabb bbox;
+    // Intersects the rays of mask in a packet, narrowing each ray's tmax and filling its record
+    // on a hit. Returns the rays that hit. This fallback traces them one at a time, each with
+    // its own random stream; acceleration structures override it to test the whole packet at
+    // once.
+    virtual uint32_t hit_packet(ray_packet& packet, uint32_t mask, hit_record* recs) const {
+        uint32_t hits = 0;
+        for (int k = 0; k < packet.size; k++) {
+            if (!(mask & (1u << k))) continue;
+            hit_record temp_rec;
+            std::swap(thread_rng(), packet.rng[k]);
+            bool hit = this->hit(packet.rays[k], interval(packet.tmin, packet.tmax[k]), temp_rec);
+            std::swap(thread_rng(), packet.rng[k]);
+            if (hit) {
+                recs[k] = temp_rec;
+                packet.set_tmax(k, temp_rec.t);
+                hits |= 1u << k;
+            }
+        }
+        return hits;
+    }
 };
 
-class rotate_y : public hittable {
+// An object placed in the scene by an affine transform. Many instances can share one object,
+// typically a BVH (the bottom level), and are themselves gathered in a BVH (the top level), so
+// a mesh placed a thousand times is stored once. A ray is carried into object space by the
+// cached inverse; the hit is carried back, with its normal through the inverse transpose.
+// Instancing an instance composes the two transforms over the inner object, so chains of
+// translate and rotate_y cost one transform per ray however long they are. The inner transform
+// is kept, so moving the outer instance later still applies it.
+class instance : public hittable {
   public:
-    rotate_y(shared_ptr<hittable> object, double angle) : object(object) {
-        auto radians = degrees_to_radians(angle);
-        sin_theta = std::sin(radians);
-        cos_theta = std::cos(radians);
-        bbox = object->bounding_box();
-
-        point3 min( infinity,  infinity,  infinity);
-        point3 max(-infinity, -infinity, -infinity);
-
-        for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 2; j++) {
-                for (int k = 0; k < 2; k++) {
-                    auto x = i*bbox.x.max + (1-i)*bbox.x.min;
-                    auto y = j*bbox.y.max + (1-j)*bbox.y.min;
-                    auto z = k*bbox.z.max + (1-k)*bbox.z.min;
-
-                    auto newx =  cos_theta*x + sin_theta*z;
-                    auto newz = -sin_theta*x + cos_theta*z;
-
-                    vec3 tester(newx, y, newz);
-
-                    for (int c = 0; c < 3; c++) {
-                        min[c] = std::fmin(min[c], tester[c]);
-                        max[c] = std::fmax(max[c], tester[c]);
-                    }
-                }
-            }
+    instance(shared_ptr<hittable> object, const affine_transform& transform)
+      : object(object), placement(transform), to_world(transform) {
+        if (auto inner = std::dynamic_pointer_cast<instance>(object)) {
+            this->object = inner->object;
+            base = inner->to_world;
+            to_world = transform * base;
         }
-
-        bbox = aabb(min, max);
+        to_object = to_world.inverse();
+        bbox = to_world.box(this->object->bounding_box());
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-
-        // Transform the ray from world space to object space.
-        auto origin = point3(
-            (cos_theta * r.origin().x()) - (sin_theta * r.origin().z()),
-            r.origin().y(),
-            (sin_theta * r.origin().x()) + (cos_theta * r.origin().z())
-        );
-
-        auto direction = vec3(
-            (cos_theta * r.direction().x()) - (sin_theta * r.direction().z()),
-            r.direction().y(),
-            (sin_theta * r.direction().x()) + (cos_theta * r.direction().z())
-        );
-
-        ray rotated_r(origin, direction, r.time());
-
-        // Determine whether an intersection exists in object space (and if so, where).
-        if (!object->hit(rotated_r, ray_t, rec))
+        // The direction is not renormalized, so t means the same in both spaces.
+        ray object_r(to_object.point(r.origin()), to_object.vector(r.direction()), r.time());
+        if (!object->hit(object_r, ray_t, rec))
             return false;
 
-        // Transform the intersection from object space back to world space.
-        rec.p = point3(
-            (cos_theta * rec.p.x()) + (sin_theta * rec.p.z()),
-            rec.p.y(),
-            (-sin_theta * rec.p.x()) + (cos_theta * rec.p.z())
-        );
-
-        rec.normal = vec3(
-            (cos_theta * rec.normal.x()) + (sin_theta * rec.normal.z()),
-            rec.normal.y(),
-            (-sin_theta * rec.normal.x()) + (cos_theta * rec.normal.z())
-        );
-
+        rec.p = to_world.point(rec.p);
+        rec.normal = unit_vector(to_object.transposed_vector(rec.normal));
         return true;
     }
 
     aabb bounding_box() const override { return bbox; }
 
+    void motion_bounds(aabb& open, aabb& close) const override {
+        object->motion_bounds(open, close);
+        open = to_world.box(open);
+        close = to_world.box(close);
+    }
+
+    // The transform this instance was given, without any it took over from an inner instance.
+    const affine_transform& transform() const { return placement; }
+
+    // Moves the instance: transform replaces the one it was given, and still applies after any
+    // inner instance's. A BVH holding it must then be refit (see linear_bvh::refit).
+    void set_transform(const affine_transform& transform) {
+        placement = transform;
+        to_world = transform * base;
+        to_object = to_world.inverse();
+        bbox = to_world.box(object->bounding_box());
+    }
+
   private:
     shared_ptr<hittable> object;
-    double sin_theta;
-    double cos_theta;
+    affine_transform base;          // The folded inner instances' transform; identity if none
+    affine_transform placement;     // This instance's own transform
+    affine_transform to_world;      // placement * base
+    affine_transform to_object;
     aabb bbox;
 };
 
+class translate : public instance {
+  public:
+    translate(shared_ptr<hittable> object, const vec3& offset)
+      : instance(object, affine_transform::translation(offset)) {}
+};
+
+class rotate_y : public instance {
+  public:
+    rotate_y(shared_ptr<hittable> object, double angle)
+      : instance(object, affine_transform::rotation_y(angle)) {}
+};
+
 #endif
@@ -35,10 +35,33 @@ class hittable_list : public hittable {
         return hit_anything;
     }
 
+    uint32_t hit_packet(ray_packet& packet, uint32_t mask, hit_record* recs) const override {
+        uint32_t hits = 0;
+        for (const auto& object : objects)
+            hits |= object->hit_packet(packet, mask, recs);
+        return hits;
+    }
+
     aabb bounding_box() const override {
         return bbox;
     }
 
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        // Each object is picked with equal probability, so the density is their average.
+        auto weight = 1.0 / objects.size();
+        auto sum = 0.0;
+
+        for (const auto& object : objects)
+            sum += weight * object->pdf_value(origin, direction);
+
+        return sum;
+    }
+
+    vec3 random(const point3& origin) const override {
+        auto int_size = int(objects.size());
+        return objects[random_int(0, int_size-1)]->random(origin);
+    }
+
     private:
         aabb bbox;
 };
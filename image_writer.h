@@ -0,0 +1,373 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "framebuffer.h"
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Binary image encoders for a framebuffer: PPM (P6) and PNG store 8-bit gamma-corrected pixels,
+// PFM stores the linear floats untouched for HDR work.
+
+enum class image_format { ppm, png, pfm };
+
+inline image_format image_format_for(const std::string& filename) {
+    auto dot = filename.find_last_of('.');
+    auto ext = dot == std::string::npos ? std::string() : filename.substr(dot + 1);
+    for (auto& c : ext) c = char(std::tolower(c));
+
+    if (ext == "png") return image_format::png;
+    if (ext == "pfm") return image_format::pfm;
+    return image_format::ppm;
+}
+
+inline void image_row_to_bytes(const framebuffer& image, int j, unsigned char* out) {
+    const float* src = image.row(j);
+    for (int k = 0; k < image.width() * 3; k++)
+        out[k] = (unsigned char)linear_to_byte(src[k]);
+}
+
+inline void write_ppm_header(std::ostream& out, int width, int height) {
+    out << "P6\n" << width << ' ' << height << "\n255\n";
+}
+
+inline void write_ppm(std::ostream& out, const framebuffer& image) {
+    write_ppm_header(out, image.width(), image.height());
+    std::vector<unsigned char> bytes(size_t(image.width()) * 3);
+    for (int j = 0; j < image.height(); j++) {
+        image_row_to_bytes(image, j, bytes.data());
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+}
+
+inline void write_pfm(std::ostream& out, const framebuffer& image) {
+    // A negative scale marks the data as little-endian. PFM rows run bottom to top.
+    out << "PF\n" << image.width() << ' ' << image.height() << "\n-1.0\n";
+
+    std::vector<unsigned char> bytes(size_t(image.width()) * 3 * 4);
+    for (int j = image.height() - 1; j >= 0; j--) {
+        const float* src = image.row(j);
+        for (int k = 0; k < image.width() * 3; k++) {
+            uint32_t bits;
+            std::memcpy(&bits, &src[k], 4);
+            for (int b = 0; b < 4; b++)
+                bytes[size_t(k) * 4 + b] = (unsigned char)(bits >> (8 * b));
+        }
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+}
+
+namespace png_detail {
+
+    inline uint32_t crc32(const unsigned char* data, size_t n, uint32_t crc = 0) {
+        static const auto table = [] {
+            std::vector<uint32_t> t(256);
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < n; i++)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    inline uint32_t adler32(const std::vector<unsigned char>& data) {
+        uint32_t a = 1, b = 0;
+        for (auto byte : data) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    class bit_writer {
+      public:
+        std::vector<unsigned char> bytes;
+
+        void put(uint32_t value, int count) {
+            // Deflate packs bit fields least-significant bit first.
+            buffer |= value << filled;
+            filled += count;
+            while (filled >= 8) {
+                bytes.push_back((unsigned char)(buffer & 0xFF));
+                buffer >>= 8;
+                filled -= 8;
+            }
+        }
+
+        void put_huffman(uint32_t code, int length) {
+            // Huffman codes are stored most-significant bit first.
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; i++)
+                reversed |= ((code >> i) & 1) << (length - 1 - i);
+            put(reversed, length);
+        }
+
+        void flush() {
+            if (filled > 0) bytes.push_back((unsigned char)(buffer & 0xFF));
+            buffer = 0;
+            filled = 0;
+        }
+
+      private:
+        uint32_t buffer = 0;
+        int filled = 0;
+    };
+
+    inline void put_literal(bit_writer& out, int symbol) {
+        // Fixed Huffman code for the literal/length alphabet (RFC 1951, 3.2.6).
+        if (symbol < 144)      out.put_huffman(0x30 + symbol, 8);
+        else if (symbol < 256) out.put_huffman(0x190 + symbol - 144, 9);
+        else if (symbol < 280) out.put_huffman(symbol - 256, 7);
+        else                   out.put_huffman(0xC0 + symbol - 280, 8);
+    }
+
+    inline void put_match(bit_writer& out, int length, int distance) {
+        static const int length_base[] = {
+            3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258
+        };
+        static const int length_extra[] = {
+            0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0
+        };
+        static const int dist_base[] = {
+            1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,
+            4097,6145,8193,12289,16385,24577
+        };
+        static const int dist_extra[] = {
+            0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13
+        };
+
+        int lc = 28;
+        while (length_base[lc] > length) lc--;
+        put_literal(out, 257 + lc);
+        out.put(length - length_base[lc], length_extra[lc]);
+
+        int dc = 29;
+        while (dist_base[dc] > distance) dc--;
+        out.put_huffman(dc, 5);
+        out.put(distance - dist_base[dc], dist_extra[dc]);
+    }
+
+    // Zlib stream holding a single fixed-Huffman deflate block, with greedy LZ77 matching over
+    // hash chains. Filtered render output is dominated by short repeats, which this catches
+    // well enough without carrying a full zlib implementation.
+    inline std::vector<unsigned char> zlib_compress(const std::vector<unsigned char>& data) {
+        const int window = 32768;
+        const int max_chain = 32;
+        const int hash_size = 1 << 15;
+
+        bit_writer out;
+        out.bytes = {0x78, 0x01};
+        out.put(1, 1);  // BFINAL
+        out.put(1, 2);  // BTYPE = fixed Huffman
+
+        std::vector<int> head(hash_size, -1);
+        std::vector<int> prev(window, -1);
+        auto hash = [&](size_t i) {
+            return ((data[i] << 10) ^ (data[i+1] << 5) ^ data[i+2]) & (hash_size - 1);
+        };
+        auto insert = [&](size_t i) {
+            if (i + 2 >= data.size()) return;
+            int h = hash(i);
+            prev[i % window] = head[h];
+            head[h] = int(i);
+        };
+
+        size_t i = 0;
+        while (i < data.size()) {
+            int best_length = 0, best_distance = 0;
+            if (i + 2 < data.size()) {
+                int candidate = head[hash(i)];
+                int max_length = int(std::min<size_t>(258, data.size() - i));
+                for (int chain = 0; candidate >= 0 && chain < max_chain; chain++) {
+                    int distance = int(i) - candidate;
+                    if (distance > window) break;
+                    int length = 0;
+                    while (length < max_length && data[candidate + length] == data[i + length])
+                        length++;
+                    if (length > best_length) {
+                        best_length = length;
+                        best_distance = distance;
+                        if (length == max_length) break;
+                    }
+                    int next = prev[candidate % window];
+                    if (next >= candidate) break;
+                    candidate = next;
+                }
+            }
+
+            if (best_length >= 3) {
+                put_match(out, best_length, best_distance);
+                for (int k = 0; k < best_length; k++)
+                    insert(i + k);
+                i += best_length;
+            } else {
+                put_literal(out, data[i]);
+                insert(i);
+                i++;
+            }
+        }
+
+        put_literal(out, 256);  // End of block
+        out.flush();
+
+        uint32_t checksum = adler32(data);
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.bytes.push_back((unsigned char)(checksum >> shift));
+        return out.bytes;
+    }
+
+    inline void write_chunk(std::ostream& out, const char* type, const std::vector<unsigned char>& data) {
+        unsigned char header[8];
+        uint32_t n = uint32_t(data.size());
+        for (int b = 0; b < 4; b++) header[b] = (unsigned char)(n >> (24 - 8 * b));
+        std::memcpy(header + 4, type, 4);
+
+        uint32_t crc = crc32(header + 4, 4);
+        crc = crc32(data.data(), data.size(), crc);
+        unsigned char trailer[4];
+        for (int b = 0; b < 4; b++) trailer[b] = (unsigned char)(crc >> (24 - 8 * b));
+
+        out.write(reinterpret_cast<const char*>(header), 8);
+        out.write(reinterpret_cast<const char*>(data.data()), data.size());
+        out.write(reinterpret_cast<const char*>(trailer), 4);
+    }
+
+    inline int paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return a;
+        return pb <= pc ? b : c;
+    }
+}
+
+inline void write_png(std::ostream& out, const framebuffer& image) {
+    using namespace png_detail;
+
+    int width = image.width(), height = image.height();
+    size_t stride = size_t(width) * 3;
+
+    // Filter each scanline with whichever of the five PNG filters gives the smallest sum of
+    // absolute residuals, the usual heuristic for picking a filter per row.
+    std::vector<unsigned char> filtered;
+    filtered.reserve((stride + 1) * height);
+    std::vector<unsigned char> previous(stride, 0), current(stride), candidate(stride), best(stride);
+
+    for (int j = 0; j < height; j++) {
+        image_row_to_bytes(image, j, current.data());
+
+        long best_score = -1;
+        int best_filter = 0;
+        for (int filter = 0; filter < 5; filter++) {
+            long score = 0;
+            for (size_t k = 0; k < stride; k++) {
+                int a = k >= 3 ? current[k-3] : 0;
+                int b = previous[k];
+                int c = k >= 3 ? previous[k-3] : 0;
+                int predicted = filter == 0 ? 0
+                              : filter == 1 ? a
+                              : filter == 2 ? b
+                              : filter == 3 ? (a + b) / 2
+                                            : paeth(a, b, c);
+                candidate[k] = (unsigned char)(current[k] - predicted);
+                score += std::abs(int((signed char)candidate[k]));
+            }
+            if (best_score < 0 || score < best_score) {
+                best_score = score;
+                best_filter = filter;
+                best.swap(candidate);
+            }
+        }
+
+        filtered.push_back((unsigned char)best_filter);
+        filtered.insert(filtered.end(), best.begin(), best.end());
+        previous.swap(current);
+    }
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.write(reinterpret_cast<const char*>(signature), 8);
+
+    std::vector<unsigned char> header(13, 0);
+    for (int b = 0; b < 4; b++) {
+        header[b]     = (unsigned char)(width >> (24 - 8 * b));
+        header[4 + b] = (unsigned char)(height >> (24 - 8 * b));
+    }
+    header[8] = 8;  // Bit depth
+    header[9] = 2;  // Colour type: truecolour RGB
+    write_chunk(out, "IHDR", header);
+    write_chunk(out, "IDAT", zlib_compress(filtered));
+    write_chunk(out, "IEND", {});
+}
+
+inline bool write_image(const std::string& filename, const framebuffer& image) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open " << filename << " for writing.\n";
+        return false;
+    }
+
+    switch (image_format_for(filename)) {
+        case image_format::ppm: write_ppm(file, image); break;
+        case image_format::png: write_png(file, image); break;
+        case image_format::pfm: write_pfm(file, image); break;
+    }
+    return bool(file);
+}
+
+// Runs image encoding on background threads so the render loop never waits on formatting or
+// disk I/O. The framebuffer is shared with the encoder, which keeps it alive until it is done.
+class image_encoder {
+  public:
+    image_encoder() = default;
+    image_encoder(const image_encoder&) = delete;
+    image_encoder& operator=(const image_encoder&) = delete;
+
+    ~image_encoder() { wait(); }
+
+    // Writes a finished framebuffer to filename, in the format its extension names, then calls
+    // on_done (if given) from the encoder thread.
+    void encode(shared_ptr<const framebuffer> image, const std::string& filename,
+                std::function<void()> on_done = nullptr) {
+        threads.emplace_back([image, filename, on_done] {
+            if (write_image(filename, *image) && on_done)
+                on_done();
+        });
+    }
+
+    // Writes a binary PPM to out one row at a time, each as soon as the renderer has finished
+    // it, so a downstream encoder in a pipe can start before the render completes.
+    void stream(shared_ptr<const framebuffer> image, std::ostream& out) {
+        threads.emplace_back([image, &out] {
+            write_ppm_header(out, image->width(), image->height());
+            std::vector<unsigned char> bytes(size_t(image->width()) * 3);
+            for (int j = 0; j < image->height(); j++) {
+                image->wait_for_row(j);
+                image_row_to_bytes(*image, j, bytes.data());
+                out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+                out.flush();
+            }
+        });
+    }
+
+    // Blocks until every queued encode and stream has finished.
+    void wait() {
+        for (auto& t : threads)
+            t.join();
+        threads.clear();
+    }
+
+  private:
+    std::vector<std::thread> threads;
+};
+
+#endif
@@ -0,0 +1,654 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "BVH.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// One node of a linear_bvh, 32 bytes. Bounds are stored as floats rounded and padded outward,
+// so the box test stays conservative for double rays and for the float rays of a packet.
+struct linear_bvh_node {
+    float    lo[3], hi[3];
+    uint32_t offset;            // Interior: index of the second child (the first follows this
+                                // node); leaf: index of the first object
+    uint16_t count;             // Objects in a leaf; 0 for an interior node
+    uint8_t  axis;              // Split axis of an interior node, for near-first traversal
+    uint8_t  pad;
+};
+
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should fill half a cache line");
+
+template <int N> class wide_bvh;
+class mesh_cache;
+class motion_bvh;
+
+// A BVH flattened into one array of nodes in depth-first order, with the objects of every leaf
+// stored contiguously. Traversal runs in a loop over an explicit stack instead of recursive
+// virtual calls, visits the child on the ray's side of the split first, and skips boxes beyond
+// the closest hit found so far.
+class linear_bvh : public hittable {
+  public:
+    linear_bvh(hittable_list list, const bvh_options& options = bvh_node::default_options())
+      : objects(std::move(list.objects)), options(options) {
+        rebuild();
+        this->options.pool = nullptr;   // The pool need not outlive the build
+    }
+
+    // Updates for scenes that change between frames. Each keeps the tree's shape where it can
+    // and rebuilds it from scratch once its SAH cost (sah_cost) exceeds the cost after the last
+    // full build by options.rebuild_threshold.
+
+    // Recomputes every box bottom-up from the objects' current bounds, after some have moved
+    // (see instance::set_transform).
+    void refit() {
+        render_stats::scoped_phase timing(render_phase::bvh_build);
+        if (nodes.empty())
+            return;
+        for (size_t index = nodes.size(); index-- > 0; )
+            refit_node(index);
+        bbox = node_box(nodes[0]);
+        check_quality();
+    }
+
+    // Adds an object, rebuilding only a small subtree: the one reached by descending into the
+    // child whose box grows least.
+    void insert(shared_ptr<hittable> object) {
+        render_stats::scoped_phase timing(render_phase::bvh_build);
+        if (nodes.empty()) {
+            objects.push_back(std::move(object));
+            rebuild();
+            return;
+        }
+
+        auto box = object->bounding_box();
+        float lo[3], hi[3];
+        ray_packet::box_bounds(box, lo, hi);
+
+        std::vector<uint32_t> path;
+        uint32_t index = 0;
+        while (nodes[index].count == 0 && object_count(index) > local_rebuild_size) {
+            path.push_back(index);
+            uint32_t first = index + 1, second = nodes[index].offset;
+            index = growth(nodes[first], lo, hi) <= growth(nodes[second], lo, hi) ? first : second;
+        }
+
+        auto range = object_range(index);
+        objects.insert(objects.begin() + range.second, std::move(object));
+        rebuild_subtree(index, path, range.first, range.second, range.second + 1);
+    }
+
+    // Removes an object, rebuilding only a small subtree around it. Returns false if the object
+    // is not in the tree.
+    bool remove(const shared_ptr<hittable>& object) {
+        render_stats::scoped_phase timing(render_phase::bvh_build);
+        auto found = std::find(objects.begin(), objects.end(), object);
+        if (found == objects.end())
+            return false;
+        auto position = size_t(found - objects.begin());
+        if (objects.size() == 1) {
+            objects.clear();
+            rebuild();
+            return true;
+        }
+
+        // Descend only into children that keep an object after the removal.
+        std::vector<uint32_t> path;
+        uint32_t index = 0;
+        while (nodes[index].count == 0 && object_count(index) > local_rebuild_size) {
+            uint32_t first = index + 1, second = nodes[index].offset;
+            auto child = position < object_range(second).first ? first : second;
+            if (object_count(child) < 2)
+                break;
+            path.push_back(index);
+            index = child;
+        }
+
+        auto range = object_range(index);
+        objects.erase(found);
+        rebuild_subtree(index, path, range.first, range.second, range.second - 1);
+        return true;
+    }
+
+    // The expected cost of a ray through the root's box under the surface area heuristic, in
+    // units of options.intersection_cost; lower is better.
+    double sah_cost() const {
+        if (nodes.empty())
+            return 0;
+        double cost = 0;
+        for (const auto& node : nodes)
+            cost += node_area(node) * (node.count > 0 ? node.count * options.intersection_cost
+                                                      : options.traversal_cost);
+        double root_area = node_area(nodes[0]);
+        return root_area > 0 ? cost / root_area : cost;
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return !nodes.empty() && traverse(0, r, ray_t, rec);
+    }
+
+    uint32_t hit_packet(ray_packet& packet, uint32_t mask, hit_record* recs) const override {
+        // Traces the packet through the tree in SIMD. At each interior node, the rays going
+        // each way along the split axis are queued in their own near-first order, so every ray
+        // meets the leaves in the same order as when traced alone. Once too few rays remain
+        // for the wide test to pay off, they finish the subtree one at a time.
+        if (nodes.empty())
+            return 0;
+
+        uint32_t negative[3] = {0, 0, 0};
+        for (int k = 0; k < packet.size; k++)
+            for (int axis = 0; axis < 3; axis++)
+                if (std::signbit(packet.rays[k].direction()[axis]))
+                    negative[axis] |= 1u << k;
+
+        struct entry { uint32_t node, mask; };
+        // Each interior node replaces its entry with up to four, so the stack holds at most
+        // three per level.
+        entry fixed[3 * stack_size + 1];
+        std::vector<entry> heap;
+        entry* stack = fixed;
+        if (depth > stack_size) {
+            heap.resize(3 * depth + 1);
+            stack = heap.data();
+        }
+
+        uint32_t hits = 0;
+        int top = 0;
+        stack[top++] = {0, mask};
+        while (top > 0) {
+            auto current = stack[--top];
+            const auto& node = nodes[current.node];
+            RT_STAT(bvh_nodes);
+            RT_STAT(packet_box_tests);
+            uint32_t active = packet.box_hit(node.lo, node.hi, current.mask);
+            if (active == 0)
+                continue;
+
+            if (ray_packet::count(active) < min_packet_rays) {
+                hits |= trace_alone(current.node, packet, active, recs);
+            } else if (node.count > 0) {
+                for (uint32_t k = node.offset; k < node.offset + node.count; k++)
+                    hits |= objects[k]->hit_packet(packet, active, recs);
+            } else {
+                uint32_t first = current.node + 1, second = node.offset;
+                uint32_t backward = active & negative[node.axis];
+                uint32_t forward = active & ~backward;
+                // Popped in reverse: forward rays take first then second, backward the opposite.
+                if (backward) stack[top++] = {first, backward};
+                if (backward) stack[top++] = {second, backward};
+                if (forward)  stack[top++] = {second, forward};
+                if (forward)  stack[top++] = {first, forward};
+            }
+        }
+        return hits;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t node_count() const { return nodes.size(); }
+
+  private:
+    template <int N> friend class wide_bvh;    // Collapses the binary tree into wide nodes
+    friend class motion_bvh;                    // Bounds the tree at two times
+    template <typename Real> friend class basic_triangle_mesh;     // Keeps the nodes over its faces
+
+    static const int stack_size = 64;
+    static const int min_packet_rays = 2;
+
+    // Updates rebuild the subtree over at most this many objects, or a bit more.
+    static const size_t local_rebuild_size = 32;
+
+    std::vector<linear_bvh_node> nodes;
+    std::vector<shared_ptr<hittable>> objects;  // Reordered so every leaf's objects are adjacent
+    bvh_options options;                        // For updates, without the build pool
+    aabb bbox;
+    int depth = 0;                              // Nodes on the longest root-to-leaf path
+    double built_cost = 0;                      // sah_cost() after the last full build
+
+    void rebuild() {
+        render_stats::scoped_phase timing(render_phase::bvh_build);
+        nodes.clear();
+        depth = 0;
+        bbox = aabb::empty;
+        if (!objects.empty()) {
+            nodes.reserve(2 * objects.size());
+            if (options.split == bvh_split::morton) {
+                auto codes = sort_by_morton_code(options.pool);
+                bbox = build_morton(0, objects.size(), codes, options, nodes, depth);
+            } else {
+                bbox = build_split(0, objects.size(), options, nodes, depth);
+            }
+        }
+        built_cost = sah_cost();
+    }
+
+    void check_quality() {
+        if (sah_cost() > options.rebuild_threshold * built_cost)
+            rebuild();
+    }
+
+    // Replaces the subtree at index, which held objects[first, old_end) and now holds
+    // objects[first, new_end), by a fresh build over them. The nodes and objects after it move,
+    // and the boxes of its ancestors, listed in path from the root, are refit.
+    void rebuild_subtree(uint32_t index, const std::vector<uint32_t>& path, size_t first,
+                         size_t old_end, size_t new_end) {
+        auto old_nodes_end = subtree_end(index);
+        std::vector<linear_bvh_node> rebuilt;
+        int subtree_depth;
+        build_split(first, new_end, options, rebuilt, subtree_depth);
+        for (auto& node : rebuilt)
+            if (node.count == 0)
+                node.offset += index;
+
+        auto node_shift = int64_t(rebuilt.size()) - int64_t(old_nodes_end - index);
+        auto object_shift = int64_t(new_end) - int64_t(old_end);
+        for (size_t k = 0; k < nodes.size(); k++) {
+            if (k >= index && k < old_nodes_end)
+                continue;
+            auto& node = nodes[k];
+            if (node.count == 0 && node.offset >= old_nodes_end)
+                node.offset = uint32_t(node.offset + node_shift);
+            else if (node.count > 0 && node.offset >= old_end)
+                node.offset = uint32_t(node.offset + object_shift);
+        }
+        nodes.erase(nodes.begin() + index, nodes.begin() + old_nodes_end);
+        nodes.insert(nodes.begin() + index, rebuilt.begin(), rebuilt.end());
+
+        for (auto k = path.size(); k-- > 0; )
+            refit_node(path[k]);
+        depth = std::max(depth, int(path.size()) + subtree_depth);
+        bbox = node_box(nodes[0]);
+        check_quality();
+    }
+
+    void refit_node(size_t index) {
+        auto& node = nodes[index];
+        if (node.count > 0) {
+            aabb bounds = aabb::empty;
+            for (uint32_t k = node.offset; k < node.offset + node.count; k++)
+                bounds = aabb(bounds, objects[k]->bounding_box());
+            ray_packet::box_bounds(bounds, node.lo, node.hi);
+            return;
+        }
+        const auto& first = nodes[index + 1];
+        const auto& second = nodes[node.offset];
+        for (int axis = 0; axis < 3; axis++) {
+            node.lo[axis] = std::fmin(first.lo[axis], second.lo[axis]);
+            node.hi[axis] = std::fmax(first.hi[axis], second.hi[axis]);
+        }
+    }
+
+    // One past the last node of the subtree at index: the end of its last child's subtree.
+    uint32_t subtree_end(uint32_t index) const {
+        while (nodes[index].count == 0)
+            index = nodes[index].offset;
+        return index + 1;
+    }
+
+    // The objects of the subtree at index, which are contiguous: from its first leaf's first
+    // object to its last leaf's last.
+    std::pair<size_t, size_t> object_range(uint32_t index) const {
+        auto first = index, last = index;
+        while (nodes[first].count == 0)
+            first++;
+        while (nodes[last].count == 0)
+            last = nodes[last].offset;
+        return {nodes[first].offset, nodes[last].offset + nodes[last].count};
+    }
+
+    size_t object_count(uint32_t index) const {
+        auto range = object_range(index);
+        return range.second - range.first;
+    }
+
+    static aabb node_box(const linear_bvh_node& node) {
+        return aabb(point3(node.lo[0], node.lo[1], node.lo[2]),
+                    point3(node.hi[0], node.hi[1], node.hi[2]));
+    }
+
+    static double node_area(const linear_bvh_node& node) {
+        double dx = node.hi[0] - node.lo[0], dy = node.hi[1] - node.lo[1],
+               dz = node.hi[2] - node.lo[2];
+        return 2 * (dx*dy + dy*dz + dz*dx);
+    }
+
+    // How much the node's surface area grows to take in the box lo, hi.
+    static double growth(const linear_bvh_node& node, const float lo[3], const float hi[3]) {
+        linear_bvh_node grown = node;
+        for (int axis = 0; axis < 3; axis++) {
+            grown.lo[axis] = std::fmin(node.lo[axis], lo[axis]);
+            grown.hi[axis] = std::fmax(node.hi[axis], hi[axis]);
+        }
+        return node_area(grown) - node_area(node);
+    }
+
+    // Subtrees over at least this many objects build their two halves in parallel.
+    static const size_t parallel_grain = 4096;
+
+    // The builders append the subtree over objects[start, end) to out in depth-first order, with
+    // interior offsets relative to the start of out. They return its bounds and set its depth.
+
+    // Top-down, splitting where bvh_splitter decides (SAH or median).
+    aabb build_split(size_t start, size_t end, const bvh_options& options,
+                     std::vector<linear_bvh_node>& out, int& subtree_depth) {
+        auto index = out.size();
+        out.emplace_back();
+
+        aabb bounds = aabb::empty;
+        for (size_t k = start; k < end; k++)
+            bounds = aabb(bounds, objects[k]->bounding_box());
+        ray_packet::box_bounds(bounds, out[index].lo, out[index].hi);
+
+        int axis;
+        auto mid = bvh_splitter::partition(objects, start, end, bounds, options, axis);
+        if (mid == end && end - start > UINT16_MAX)
+            mid = start + (end - start) / 2;    // More objects than a leaf can count
+
+        if (mid == end) {
+            make_leaf(out[index], start, end);
+            subtree_depth = 1;
+            return bounds;
+        }
+
+        auto build = [&](size_t s, size_t e, std::vector<linear_bvh_node>& o, int& d) {
+            return build_split(s, e, options, o, d);
+        };
+        build_children(index, start, mid, end, axis, options.pool, out, subtree_depth, build);
+        return bounds;
+    }
+
+    // Over objects sorted by the Morton codes of their centroids (see sort_by_morton_code), each
+    // split falls where the highest bit that differs across the range turns from 0 to 1. Bounds
+    // are gathered bottom-up, so no level rescans its objects.
+    aabb build_morton(size_t start, size_t end, const std::vector<uint64_t>& codes,
+                      const bvh_options& options, std::vector<linear_bvh_node>& out,
+                      int& subtree_depth) {
+        auto index = out.size();
+        out.emplace_back();
+
+        auto span = end - start;
+        if (span <= size_t(std::max(1, options.max_leaf_size))) {
+            aabb bounds = aabb::empty;
+            for (size_t k = start; k < end; k++)
+                bounds = aabb(bounds, objects[k]->bounding_box());
+            ray_packet::box_bounds(bounds, out[index].lo, out[index].hi);
+            make_leaf(out[index], start, end);
+            subtree_depth = 1;
+            return bounds;
+        }
+
+        size_t mid;
+        int axis = 0;
+        uint64_t differing = codes[start] ^ codes[end - 1];
+        if (differing == 0) {
+            mid = start + span / 2;             // Identical codes: split the range in half
+        } else {
+            int bit = 63;
+            while (!((differing >> bit) & 1))
+                bit--;
+            uint64_t mask = uint64_t(1) << bit;
+            mid = size_t(std::partition_point(codes.begin() + start, codes.begin() + end,
+                                              [mask](uint64_t c) { return !(c & mask); })
+                         - codes.begin());
+            axis = 2 - bit % 3;                 // Bits interleave as ...xyzxyz (see morton_code)
+        }
+
+        auto build = [&](size_t s, size_t e, std::vector<linear_bvh_node>& o, int& d) {
+            return build_morton(s, e, codes, options, o, d);
+        };
+        auto bounds = build_children(index, start, mid, end, axis, options.pool, out,
+                                     subtree_depth, build);
+        ray_packet::box_bounds(bounds, out[index].lo, out[index].hi);
+        return bounds;
+    }
+
+    void make_leaf(linear_bvh_node& node, size_t start, size_t end) {
+        node.offset = uint32_t(start);
+        node.count = uint16_t(end - start);
+    }
+
+    // Builds the children of the interior node out[index] and fills in its links. With a pool
+    // and enough objects, the second child is built by another worker into its own array, then
+    // appended after the first with its offsets moved along. Returns the union of the children's
+    // bounds.
+    template <typename Build>
+    aabb build_children(size_t index, size_t start, size_t mid, size_t end, int axis,
+                        thread_pool* pool, std::vector<linear_bvh_node>& out,
+                        int& subtree_depth, Build build) {
+        int left_depth = 0, right_depth = 0;
+        aabb left_bounds, right_bounds;
+        uint32_t second;
+
+        if (pool && end - start >= parallel_grain) {
+            std::vector<linear_bvh_node> right_nodes;
+            right_nodes.reserve(2 * (end - mid));
+            task_group group(task_priority::high);
+            pool->submit(group, [&] { right_bounds = build(mid, end, right_nodes, right_depth); });
+            left_bounds = build(start, mid, out, left_depth);
+            pool->wait(group);
+
+            second = uint32_t(out.size());
+            for (auto node : right_nodes) {
+                if (node.count == 0)
+                    node.offset += second;
+                out.push_back(node);
+            }
+        } else {
+            left_bounds = build(start, mid, out, left_depth);
+            second = uint32_t(out.size());
+            right_bounds = build(mid, end, out, right_depth);
+        }
+
+        out[index].offset = second;
+        out[index].count = 0;
+        out[index].axis = uint8_t(axis);
+        subtree_depth = 1 + std::max(left_depth, right_depth);
+        return aabb(left_bounds, right_bounds);
+    }
+
+    // Sorts the objects by the 63-bit Morton codes of their bounding box centres within the
+    // bounds of all the centres, and returns the sorted codes. Codes are computed and radix
+    // sorted in parallel chunks when a pool is given.
+    std::vector<uint64_t> sort_by_morton_code(thread_pool* pool) {
+        auto n = objects.size();
+        int chunks = pool ? int(std::min<size_t>(4 * pool->size(), n / parallel_grain + 1)) : 1;
+
+        std::vector<point3> centres(n);
+        std::vector<aabb> chunk_bounds(chunks, aabb::empty);
+        for_chunks(n, chunks, pool, [&](int c, size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                auto box = objects[k]->bounding_box();
+                centres[k] = point3(0.5 * (box.x.min + box.x.max), 0.5 * (box.y.min + box.y.max),
+                                    0.5 * (box.z.min + box.z.max));
+                chunk_bounds[c] = aabb(chunk_bounds[c], aabb(centres[k], centres[k]));
+            }
+        });
+        aabb centre_bounds = aabb::empty;
+        for (const auto& box : chunk_bounds)
+            centre_bounds = aabb(centre_bounds, box);
+
+        std::vector<morton_key> keys(n);
+        for_chunks(n, chunks, pool, [&](int, size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++)
+                keys[k] = {morton_code(centres[k], centre_bounds), uint32_t(k)};
+        });
+        radix_sort(keys, chunks, pool);
+
+        std::vector<shared_ptr<hittable>> sorted(n);
+        std::vector<uint64_t> codes(n);
+        for_chunks(n, chunks, pool, [&](int, size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                sorted[k] = std::move(objects[keys[k].index]);
+                codes[k] = keys[k].code;
+            }
+        });
+        objects = std::move(sorted);
+        return codes;
+    }
+
+    struct morton_key {
+        uint64_t code;
+        uint32_t index;
+    };
+
+    static uint64_t spread_bits(uint64_t x) {
+        // Spreads the low 21 bits of x so two zero bits separate each one.
+        x &= 0x1fffff;
+        x = (x | (x << 32)) & 0x1f00000000ffffULL;
+        x = (x | (x << 16)) & 0x1f0000ff0000ffULL;
+        x = (x | (x << 8))  & 0x100f00f00f00f00fULL;
+        x = (x | (x << 4))  & 0x10c30c30c30c30c3ULL;
+        x = (x | (x << 2))  & 0x1249249249249249ULL;
+        return x;
+    }
+
+    static uint64_t morton_code(const point3& p, const aabb& bounds) {
+        uint64_t cell[3];
+        for (int axis = 0; axis < 3; axis++) {
+            const auto& range = bounds.axis_interval(axis);
+            double t = range.size() > 0 ? (p[axis] - range.min) / range.size() : 0;
+            cell[axis] = uint64_t(std::fmin(std::fmax(t * 2097152.0, 0.0), 2097151.0));
+        }
+        return (spread_bits(cell[0]) << 2) | (spread_bits(cell[1]) << 1) | spread_bits(cell[2]);
+    }
+
+    // Stable least-significant-digit radix sort on the codes, 8 bits per pass. Each chunk counts
+    // its digits, the counts are turned into per-chunk output offsets, and each chunk scatters
+    // its keys to its own offsets, so the result is the same however many chunks there are.
+    static void radix_sort(std::vector<morton_key>& keys, int chunks, thread_pool* pool) {
+        auto n = keys.size();
+        std::vector<morton_key> buffer(n);
+        std::vector<std::array<size_t, 256>> offsets(chunks);
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            for_chunks(n, chunks, pool, [&](int c, size_t begin, size_t end) {
+                offsets[c].fill(0);
+                for (size_t k = begin; k < end; k++)
+                    offsets[c][(keys[k].code >> shift) & 0xff]++;
+            });
+
+            size_t sum = 0;
+            bool shared_digit = false;          // Every key has the same digit: nothing to move
+            for (int digit = 0; digit < 256; digit++) {
+                size_t digit_start = sum;
+                for (int c = 0; c < chunks; c++) {
+                    auto count = offsets[c][digit];
+                    offsets[c][digit] = sum;
+                    sum += count;
+                }
+                if (sum - digit_start == n)
+                    shared_digit = true;
+            }
+            if (shared_digit)
+                continue;
+
+            for_chunks(n, chunks, pool, [&](int c, size_t begin, size_t end) {
+                auto& offset = offsets[c];
+                for (size_t k = begin; k < end; k++)
+                    buffer[offset[(keys[k].code >> shift) & 0xff]++] = keys[k];
+            });
+            keys.swap(buffer);
+        }
+    }
+
+    // Calls body(chunk, begin, end) for chunks of [0, count) split as evenly as possible, in
+    // parallel when a pool is given.
+    template <typename Body>
+    static void for_chunks(size_t count, int chunks, thread_pool* pool, Body body) {
+        if (!pool || chunks <= 1) {
+            body(0, 0, count);
+            return;
+        }
+        task_group group(task_priority::high);
+        for (int c = 0; c < chunks; c++) {
+            size_t begin = count * c / chunks, end = count * (c + 1) / chunks;
+            pool->submit(group, [&body, c, begin, end] { body(c, begin, end); });
+        }
+        pool->wait(group);
+    }
+
+    // Traces one ray through the subtree at root, closest hit first.
+    bool traverse(uint32_t root, const ray& r, interval ray_t, hit_record& rec) const {
+        const auto& origin = r.origin();
+        const auto& direction = r.direction();
+        double o[3] = {origin.x(), origin.y(), origin.z()};
+        double inv[3] = {1 / direction.x(), 1 / direction.y(), 1 / direction.z()};
+        // The sign bit, not < 0, so that -0 (an infinite inverse of -inf) orders its slab right.
+        bool negative[3] = {std::signbit(direction.x()), std::signbit(direction.y()),
+                            std::signbit(direction.z())};
+
+        uint32_t fixed[stack_size];
+        std::vector<uint32_t> heap;
+        uint32_t* stack = fixed;
+        if (depth > stack_size) {
+            heap.resize(depth);
+            stack = heap.data();
+        }
+
+        bool hit_anything = false;
+        int top = 0;
+        uint32_t index = root;
+        while (true) {
+            const auto& node = nodes[index];
+            RT_STAT(bvh_nodes);
+            if (box_hit(node, o, inv, negative, ray_t)) {
+                if (node.count == 0) {
+                    uint32_t near = index + 1, far = node.offset;
+                    if (negative[node.axis])
+                        std::swap(near, far);
+                    stack[top++] = far;
+                    index = near;
+                    continue;
+                }
+                for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+                    if (objects[k]->hit(r, ray_t, rec)) {
+                        hit_anything = true;
+                        ray_t.max = rec.t;
+                    }
+                }
+            }
+            if (top == 0)
+                break;
+            index = stack[--top];
+        }
+        return hit_anything;
+    }
+
+    // The slab test of aabb::hit against a node's bounds, with the inverse direction and its
+    // signs computed once per ray.
+    static bool box_hit(const linear_bvh_node& node, const double o[3], const double inv[3],
+                        const bool negative[3], interval ray_t) {
+        RT_STAT(aabb_tests);
+        for (int axis = 0; axis < 3; axis++) {
+            double t0 = (node.lo[axis] - o[axis]) * inv[axis];
+            double t1 = (node.hi[axis] - o[axis]) * inv[axis];
+            if (negative[axis])
+                std::swap(t0, t1);
+            if (t0 > ray_t.min) ray_t.min = t0;
+            if (t1 < ray_t.max) ray_t.max = t1;
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+
+    // The rays of mask finish the subtree at root one at a time, as in hittable::hit_packet.
+    uint32_t trace_alone(uint32_t root, ray_packet& packet, uint32_t mask, hit_record* recs) const {
+        uint32_t hits = 0;
+        for (int k = 0; k < packet.size; k++) {
+            if (!(mask & (1u << k))) continue;
+            hit_record temp_rec;
+            std::swap(thread_rng(), packet.rng[k]);
+            bool hit = traverse(root, packet.rays[k], interval(packet.tmin, packet.tmax[k]), temp_rec);
+            std::swap(thread_rng(), packet.rng[k]);
+            if (hit) {
+                recs[k] = temp_rec;
+                packet.set_tmax(k, temp_rec.t);
+                hits |= 1u << k;
+            }
+        }
+        return hits;
+    }
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define MATERIAL_H
 
 #include "hittable.h"
+#include "onb.h"
+#include "sampler.h"
 #include "texture.h"
 
 class material {
@@ -12,8 +14,10 @@ class material {
         return color(0,0,0);
     }
 
+    // Draws the scattered ray's random numbers from the sampler, so the BSDF dimensions get the
+    // same stratification as the camera's.
     virtual bool scatter(
-        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& smp
     ) const {
         return false;
     }
@@ -22,6 +26,11 @@ class material {
     const {
         return 0;
     }
+
+    // Surface colour at the hit, written to the albedo AOV for the denoiser.
+    virtual color surface_albedo(const hit_record& rec) const {
+        return color(0,0,0);
+    }
 };
 
 class lambertian : public material {
@@ -30,11 +39,10 @@ class lambertian : public material {
     lambertian(shared_ptr<texture> tex) : tex(tex) {}
 
     virtual bool scatter(
-        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& smp
     ) const override {
-        auto scatter_direction = rec.normal + random_unit_vector();
-        if (scatter_direction.near_zero())
-            scatter_direction = rec.normal;
+        auto s = smp.get_2d();
+        auto scatter_direction = onb(rec.normal).transform(sample_cosine_hemisphere(s.u, s.v));
 
         scattered = ray(rec.p, scatter_direction, r_in.time());
         attenuation = tex->value(rec.u, rec.v, rec.p);
@@ -47,6 +55,10 @@ class lambertian : public material {
         return cos_theta < 0 ? 0 : cos_theta/pi;
     }
 
+    color surface_albedo(const hit_record& rec) const override {
+        return tex->value(rec.u, rec.v, rec.p);
+    }
+
   private:
     shared_ptr<texture> tex;
 };
@@ -55,15 +67,19 @@ class metal : public material {
   public:
     metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
-    const override {
+    bool scatter(
+        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& smp
+    ) const override {
         vec3 reflected = reflect(r_in.direction(), rec.normal);
-        reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
+        auto s = smp.get_2d();
+        reflected = unit_vector(reflected) + (fuzz * sample_sphere(s.u, s.v));
         scattered = ray(rec.p, reflected, r_in.time());
         attenuation = albedo;
         return (dot(scattered.direction(), rec.normal) > 0);
     }
 
+    color surface_albedo(const hit_record& rec) const override { return albedo; }
+
   private:
     color albedo;
     double fuzz;
@@ -73,8 +89,9 @@ class dielectric : public material {
   public:
     dielectric(double refraction_index) : refraction_index(refraction_index) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
-    const override {
+    bool scatter(
+        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& smp
+    ) const override {
         attenuation = color(1.0, 1.0, 1.0);
         double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
 
@@ -85,7 +102,7 @@ class dielectric : public material {
         bool cannot_refract = ri * sin_theta > 1.0;
         vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+        if (cannot_refract || reflectance(cos_theta, ri) > smp.get_1d())
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, ri);
@@ -94,6 +111,8 @@ class dielectric : public material {
         return true;
     }
 
+    color surface_albedo(const hit_record& rec) const override { return color(1,1,1); }
+
   private:
     double refraction_index;
     static double reflectance(double cosine, double refraction_index) {
@@ -112,6 +131,12 @@ class diffuse_light : public material {
         return tex->value(u, v, p);
     }
 
+    color surface_albedo(const hit_record& rec) const override {
+        // Emission clamped into the albedo range.
+        auto e = emitted(rec.u, rec.v, rec.p);
+        return color(std::fmin(e.x(), 1.0), std::fmin(e.y(), 1.0), std::fmin(e.z(), 1.0));
+    }
+
   private:
     shared_ptr<texture> tex;
 };
@@ -121,13 +146,24 @@ class isotropic : public material {
     isotropic(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
     isotropic(shared_ptr<texture> tex) : tex(tex) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
-    const override {
-        scattered = ray(rec.p, random_unit_vector(), r_in.time());
+    bool scatter(
+        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& smp
+    ) const override {
+        auto s = smp.get_2d();
+        scattered = ray(rec.p, sample_sphere(s.u, s.v), r_in.time());
         attenuation = tex->value(rec.u, rec.v, rec.p);
         return true;
     }
 
+    double scattering_pdf(const ray& r_in, const hit_record& rec, const ray& scattered)
+    const override {
+        return 1 / (4 * pi);
+    }
+
+    color surface_albedo(const hit_record& rec) const override {
+        return tex->value(rec.u, rec.v, rec.p);
+    }
+
   private:
     shared_ptr<texture> tex;
 };
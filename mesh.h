@@ -1,39 +1,145 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include "bvh_factory.h"
 #include "hittable_list.h"
+#include "mesh_cache.h"
 #include "tri.h"
+#include "triangle_mesh.h"
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <array>
+#include <unordered_map>
+#include <vector>
+
+// Faces over shared vertices, as one triangle_mesh when the default layout is linear. Other
+// layouts get a tri per face in make_bvh's layout, so they can still be compared on meshes.
+inline shared_ptr<hittable> make_triangle_mesh(const std::vector<point3>& vertices,
+                                               std::vector<uint32_t> faces,
+                                               std::vector<shared_ptr<material>> materials,
+                                               std::vector<uint32_t> face_materials = {}) {
+    if (bvh_node::default_options().layout == bvh_layout::linear)
+        return make_shared<triangle_mesh>(vertices, std::move(faces), std::move(materials),
+                                          std::move(face_materials));
+
+    hittable_list list;
+    list.objects.reserve(faces.size() / 3);
+    for (size_t face = 0; 3 * face < faces.size(); face++) {
+        const auto& mat = materials[face_materials.empty() ? 0 : face_materials[face]];
+        list.add(make_shared<tri>(vertices[faces[3*face]], vertices[faces[3*face + 1]],
+                                  vertices[faces[3*face + 2]], mat));
+    }
+    return make_bvh(std::move(list));
+}
 
 class mesh {
 public:
-    mesh(const std::string& path, const shared_ptr<material>& mat) {
-        geometry = load_ascii_stl(path, mat);
-    }
+    // The file is read when the geometry or BVH is first asked for.
+    mesh(const std::string& path, const shared_ptr<material>& mat)
+      : path(resolve_path(path)), mat(mat) {}
 
-    shared_ptr<hittable_list> get_geometry() const {
+    // The faces as separate tris.
+    shared_ptr<hittable_list> get_geometry() {
+        if (!geometry) {
+            load();
+            geometry = make_shared<hittable_list>();
+            geometry->objects.reserve(faces.size() / 3);
+            for (size_t k = 0; k < faces.size(); k += 3)
+                geometry->add(make_shared<tri>(vertices[faces[k]], vertices[faces[k + 1]],
+                                               vertices[faces[k + 2]], mat));
+        }
         return geometry;
     }
 
+    // The faces under one acceleration structure, built on first use: a triangle_mesh in the
+    // linear layout (see make_triangle_mesh). Place the mesh many times by sharing it between
+    // instances (see instance in hittable.h). Linear meshes are kept in the mesh cache
+    // (mesh_cache.h) when it is on, so an unchanged file loads with no parsing or building.
+    shared_ptr<hittable> get_bvh() {
+        if (bvh)
+            return bvh;
+
+        const auto& options = bvh_node::default_options();
+        uint64_t key = 0;
+        std::string cache_path;
+        if (!cache_directory().empty() && options.layout == bvh_layout::linear) {
+            key = mesh_cache::key(path, options);
+            cache_path = mesh_cache::path_for(cache_directory(), path);
+        }
+        if (key != 0) {
+            if (auto cached = mesh_cache::load(cache_path, key, mat)) {
+                std::clog << "Loaded " << path << " from " << cache_path << "\n";
+                bvh = cached;
+                return bvh;
+            }
+            load();
+            auto built = make_shared<triangle_mesh>(vertices, faces,
+                                                    std::vector<shared_ptr<material>>{mat});
+            if (!mesh_cache::save(cache_path, key, *built))
+                std::clog << "Failed to write mesh cache: " << cache_path << "\n";
+            bvh = built;
+            return bvh;
+        }
+
+        load();
+        bvh = make_triangle_mesh(vertices, faces, {mat});
+        return bvh;
+    }
+
+    // Where get_bvh keeps its cache; empty turns the cache off.
+    static std::string& cache_directory() {
+        static std::string directory;
+        return directory;
+    }
+
 private:
+    std::string path;
+    shared_ptr<material> mat;
+    std::vector<point3> vertices;       // Each distinct vertex of the file once
+    std::vector<uint32_t> faces;        // Three indices into vertices per triangle, in file order
+    bool loaded = false;
     shared_ptr<hittable_list> geometry;
+    shared_ptr<hittable> bvh;
 
-    shared_ptr<hittable_list> load_ascii_stl(const std::string& path, const shared_ptr<material>& mat) {
-        auto list = make_shared<hittable_list>();
+    // Relative paths are also tried from up to three parent directories, so the bundled models
+    // load from a build directory too. Returns path unchanged if none exists.
+    static std::string resolve_path(const std::string& path) {
+        if (path.empty() || path.front() == '/' || std::ifstream(path))
+            return path;
+        std::string prefix;
+        for (int up = 1; up <= 3; up++) {
+            prefix += "../";
+            if (std::ifstream(prefix + path))
+                return prefix + path;
+        }
+        return path;
+    }
+
+    // Reads the ASCII STL at path into vertices and faces, merging repeated vertices.
+    void load() {
+        if (loaded)
+            return;
+        loaded = true;
 
         std::ifstream in(path);
         if (!in) {
             std::cerr << "Failed to open STL: " << path << "\n";
-            return list;
+            return;
         }
 
+        // Exact matches only: a vertex is shared when the file repeats its coordinates.
+        struct vertex_hash {
+            size_t operator()(const std::array<double, 3>& p) const {
+                size_t h = 0;
+                for (double c : p)
+                    h = h * 0x9e3779b97f4a7c15ULL + std::hash<double>()(c);
+                return h;
+            }
+        };
+        std::unordered_map<std::array<double, 3>, uint32_t, vertex_hash> index_of;
+
         std::string line;
-        std::array<point3, 3> verts;
-        int v = 0;
-        
         // Read through the ASCII STL file line by line
         while (std::getline(in, line)) {
             std::istringstream iss(line);
@@ -44,17 +150,17 @@ private:
                 double x, y, z;
                 // Read vertex coordinates
                 if (!(iss >> x >> y >> z)) continue;
-                verts[v++] = point3(x, y, z);
-                if (v == 3) {
-                    // We have 3 vertices, create a triangle
-                    list->add(make_shared<tri>(verts[0], verts[1], verts[2], mat));
-                    std::cout << "tri added: " << verts[0] << ", " << verts[1] << ", " << verts[2] << "\n";
-                    v = 0;
-                }
+                auto found = index_of.emplace(std::array<double, 3>{x, y, z},
+                                              uint32_t(vertices.size()));
+                if (found.second)
+                    vertices.emplace_back(x, y, z);
+                faces.push_back(found.first->second);
             }
         }
-        return list;
+        faces.resize(faces.size() - faces.size() % 3);    // Drop a trailing partial triangle
+        std::clog << "Loaded " << faces.size() / 3 << " triangles (" << vertices.size()
+                  << " vertices) from " << path << "\n";
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,272 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "triangle_mesh.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX        // Keep windows.h from defining min and max macros over std::min/max
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only memory map of a whole file. Empty if the file cannot be opened or is empty.
+class mapped_file {
+  public:
+    explicit mapped_file(const std::string& path) {
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+            return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+            return;
+        auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view)
+            return;
+        bytes = static_cast<const unsigned char*>(view);
+        length = size_t(file_size.QuadPart);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            auto view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                bytes = static_cast<const unsigned char*>(view);
+                length = size_t(info.st_size);
+            }
+        }
+        close(fd);      // The mapping stays valid
+#endif
+    }
+
+    ~mapped_file() {
+#if defined(_WIN32)
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (bytes) munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+  private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// On-disk cache of a built triangle_mesh. A cache file holds a header, the BVH's nodes as they
+// are in memory, the vertex coordinates and the faces' vertex indices in the tree's leaf order,
+// so loading it maps the file and copies each buffer in one block, with no parsing and no tree
+// building. Each file is keyed by a hash of its source file's bytes and the build options; a
+// file with another key is stale and gets rebuilt.
+class mesh_cache {
+  public:
+    // The cache file of a source in directory: the source's name plus a hash of its full path,
+    // so meshes of the same name in different directories do not share one.
+    static std::string path_for(const std::string& directory, const std::string& source) {
+        auto absolute = std::filesystem::absolute(source).string();
+        auto name = std::filesystem::path(source).stem().string() + "-"
+                  + hex(hash_bytes(absolute.data(), absolute.size(), fnv_offset)).substr(0, 8)
+                  + ".meshcache";
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    // The key of a source file under the given build options, or 0 if it cannot be read.
+    static uint64_t key(const std::string& source, const bvh_options& options) {
+        mapped_file file(source);
+        if (file.empty())
+            return 0;
+        uint64_t h = hash_bytes(file.data(), file.size(), fnv_offset);
+        int settings[] = {format_version, int(options.split), options.bins, options.max_leaf_size};
+        double costs[] = {options.traversal_cost, options.intersection_cost};
+        h = hash_bytes(settings, sizeof(settings), h);
+        return hash_bytes(costs, sizeof(costs), h);
+    }
+
+    // The mesh stored under key at path, with every face given mat; null if the file is
+    // missing, stale or damaged.
+    static shared_ptr<triangle_mesh> load(const std::string& path, uint64_t key,
+                                          const shared_ptr<material>& mat) {
+        mapped_file file(path);
+        if (file.size() < sizeof(file_header))
+            return nullptr;
+        file_header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0
+            || header.version != format_version || header.key != key || header.node_count == 0)
+            return nullptr;
+
+        auto nodes_bytes = header.node_count * sizeof(linear_bvh_node);
+        auto axis_bytes = header.vertex_count * sizeof(double);
+        auto index_bytes = header.face_count * 3 * sizeof(uint32_t);
+        if (file.size() != sizeof(header) + nodes_bytes + 3 * axis_bytes + index_bytes)
+            return nullptr;
+
+        const unsigned char* data = file.data() + sizeof(header);
+        std::vector<linear_bvh_node> nodes(header.node_count);
+        std::memcpy(nodes.data(), data, nodes_bytes);
+        data += nodes_bytes;
+        // Children come after their parent, so walking back from the end sees them first and
+        // gives each node the depth of its subtree. Traversal sizes its stack from the depth,
+        // so the stored one must match the tree's.
+        std::vector<int> subtree_depth(nodes.size());
+        for (size_t k = nodes.size(); k-- > 0;) {
+            const auto& node = nodes[k];
+            bool valid = node.count == 0
+                       ? node.offset > k + 1 && node.offset < nodes.size()
+                       : node.offset + uint64_t(node.count) <= header.face_count;
+            if (!valid)
+                return nullptr;
+            subtree_depth[k] = node.count == 0
+                             ? 1 + std::max(subtree_depth[k + 1], subtree_depth[node.offset])
+                             : 1;
+        }
+        if (header.depth != subtree_depth[0])
+            return nullptr;
+
+        std::vector<double> axes[3];
+        for (auto& axis : axes) {
+            axis.resize(header.vertex_count);
+            std::memcpy(axis.data(), data, axis_bytes);
+            data += axis_bytes;
+        }
+        std::vector<uint32_t> faces(header.face_count * 3);
+        std::memcpy(faces.data(), data, index_bytes);
+        for (auto index : faces)
+            if (index >= header.vertex_count)
+                return nullptr;
+
+        aabb bbox(interval(header.bounds[0], header.bounds[3]),
+                  interval(header.bounds[1], header.bounds[4]),
+                  interval(header.bounds[2], header.bounds[5]));
+        return make_shared<triangle_mesh>(std::move(axes[0]), std::move(axes[1]), std::move(axes[2]),
+                                          std::move(faces), std::vector<shared_ptr<material>>{mat},
+                                          std::vector<uint32_t>{}, std::move(nodes), bbox,
+                                          header.depth);
+    }
+
+    // Writes mesh's geometry and tree, though not its materials, to path under key. The file is
+    // written beside its final name and renamed into place, so concurrent readers and writers
+    // never see half of one. Returns false if it could not be written.
+    static bool save(const std::string& path, uint64_t key, const triangle_mesh& mesh) {
+        file_header header;
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = format_version;
+        header.depth = mesh.depth;
+        header.key = key;
+        header.node_count = mesh.nodes.size();
+        header.face_count = mesh.face_count();
+        header.vertex_count = mesh.vertex_count();
+        for (int axis = 0; axis < 3; axis++) {
+            header.bounds[axis] = mesh.bbox.axis_interval(axis).min;
+            header.bounds[axis + 3] = mesh.bbox.axis_interval(axis).max;
+        }
+
+        std::error_code error;
+        auto target = std::filesystem::path(path);
+        if (target.has_parent_path())
+            std::filesystem::create_directories(target.parent_path(), error);
+        // Unique to the process and thread, so no two writers share a temporary file.
+        auto temporary = path + ".tmp" + std::to_string(process_id()) + "-"
+                       + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream out(temporary, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(mesh.nodes.data()),
+                      std::streamsize(mesh.nodes.size() * sizeof(linear_bvh_node)));
+            for (const auto* axis : {&mesh.x, &mesh.y, &mesh.z})
+                out.write(reinterpret_cast<const char*>(axis->data()),
+                          std::streamsize(axis->size() * sizeof(double)));
+            out.write(reinterpret_cast<const char*>(mesh.indices.data()),
+                      std::streamsize(mesh.indices.size() * sizeof(uint32_t)));
+            if (!out)
+                return false;
+        }
+        std::filesystem::rename(temporary, target, error);
+        if (error) {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    static constexpr char magic[8] = {'R','T','M','E','S','H','\0','\0'};
+    static const int format_version = 2;
+    static const uint64_t fnv_offset = 0xcbf29ce484222325ULL;
+
+    // Host byte order and layout; the version and key reject files from a different build.
+    struct file_header {
+        char     magic[8];
+        int32_t  version;
+        int32_t  depth;
+        uint64_t key;
+        uint64_t node_count;
+        uint64_t face_count;
+        uint64_t vertex_count;
+        double   bounds[6];     // Min x, y, z, then max x, y, z of the tree's box
+    };
+
+    static unsigned long process_id() {
+#if defined(_WIN32)
+        return GetCurrentProcessId();
+#else
+        return static_cast<unsigned long>(getpid());
+#endif
+    }
+
+    // FNV-1a, taking 8 bytes at a time so that hashing a large mesh costs little next to
+    // reading it.
+    static uint64_t hash_bytes(const void* data, size_t size, uint64_t h) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        size_t k = 0;
+        for (; k + 8 <= size; k += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes + k, 8);
+            h = (h ^ word) * 0x100000001b3ULL;
+        }
+        for (; k < size; k++)
+            h = (h ^ bytes[k]) * 0x100000001b3ULL;
+        return h;
+    }
+
+    static std::string hex(uint64_t value) {
+        static const char digits[] = "0123456789abcdef";
+        std::string text(16, '0');
+        for (int k = 15; k >= 0; k--, value >>= 4)
+            text[k] = digits[value & 0xf];
+        return text;
+    }
+};
+
+#endif
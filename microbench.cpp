@@ -0,0 +1,330 @@
+// Microbenchmarks of the renderer's hot kernels: box, primitive and BVH intersection, Perlin
+// noise, direction sampling and texture lookup. Each kernel runs over a fixed batch of seeded
+// random inputs until enough time has passed to measure it, and reports ns/call and calls/s, so
+// a change to an inner loop can be judged in seconds rather than through a full render.
+#include "rtweekend.h"
+#include "AABB.h"
+#include "BVH.h"
+#include "linear_bvh.h"
+#include "motion_bvh.h"
+#include "wide_bvh.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "perlin.h"
+#include "quad.h"
+#include "sphere.h"
+#include "texture.h"
+#include "tri.h"
+#include "triangle_mesh.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+
+struct microbench_options {
+    std::string filter;             // Run only kernels whose name contains this
+    double min_seconds = 0.2;       // Time spent measuring each kernel
+    uint64_t seed = 1;
+    bool list_only = false;
+};
+
+void print_usage() {
+    std::clog <<
+        "Usage: microbench [OPTIONS]\n"
+        "\n"
+        "Times the renderer's hot kernels on seeded random inputs and reports ns/call and\n"
+        "calls/s.\n"
+        "\n"
+        "Options:\n"
+        "  --filter TEXT    run only kernels whose name contains TEXT\n"
+        "  --time SECONDS   time spent measuring each kernel (default 0.2)\n"
+        "  --seed N         seed for the random inputs (default 1)\n"
+        "  --list           list the kernels\n";
+}
+
+// Times kernels and prints one line per kernel. A kernel is called as call(k) for each input k
+// of a batch; it returns a number derived from its result (1 for a hit, a noise value, ...),
+// which is summed so the compiler cannot discard the call.
+class microbench_runner {
+  public:
+    static const int batch = 4096;  // Inputs per kernel: enough to vary, few enough to stay in cache
+
+    explicit microbench_runner(const microbench_options& options) : options(options) {
+        if (!options.list_only)
+            std::cout << std::left << std::setw(24) << "kernel" << std::right
+                      << std::setw(12) << "ns/call" << std::setw(14) << "Mcalls/s"
+                      << std::setw(10) << "hits" << '\n';
+    }
+
+    // True if the kernel should run. Also reseeds the calling thread's stream, so each kernel's
+    // inputs depend only on the seed and its name; kernels given the same inputs name share them.
+    bool selected(const std::string& name, const std::string& inputs = "") {
+        if (options.list_only) {
+            std::cout << name << '\n';
+            return false;
+        }
+        if (name.find(options.filter) == std::string::npos)
+            return false;
+        // FNV-1a rather than std::hash, which differs between standard libraries.
+        uint64_t name_hash = 0xcbf29ce484222325ULL;
+        for (unsigned char c : inputs.empty() ? name : inputs)
+            name_hash = (name_hash ^ c) * 0x100000001b3ULL;
+        thread_rng().seed(options.seed, name_hash, 0);
+        return true;
+    }
+
+    // Intersection kernels return 1 per hit and also report the fraction of calls that hit.
+    template <typename Call>
+    void run(const std::string& name, Call call, bool counts_hits = false) {
+        // One untimed batch gives the kernel's checksum and hit rate, and warms the caches.
+        double once = 0;
+        for (int k = 0; k < batch; k++)
+            once += call(k);
+        total += once;
+
+        // Calibrate: double the batches per trial until one trial takes a fifth of the budget.
+        long batches = 1;
+        while (trial(call, batches) < options.min_seconds / 5 && batches < (1L << 30))
+            batches *= 2;
+
+        // Report the fastest of five trials, the one least disturbed by the rest of the system.
+        double best = infinity;
+        for (int k = 0; k < 5; k++)
+            best = std::fmin(best, trial(call, batches));
+
+        double ns = 1e9 * best / (double(batches) * batch);
+        std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << ns
+                  << std::setw(14) << 1e3 / ns;
+        if (counts_hits)
+            std::cout << std::setprecision(1) << std::setw(9) << 100 * once / batch << '%';
+        std::cout << '\n';
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    // Sum of every kernel's results over its first batch. It depends only on the seed, so it
+    // changes when a kernel's results do.
+    double checksum() const { return total; }
+
+  private:
+    microbench_options options;
+    double total = 0;
+    volatile double sink = 0;
+
+    template <typename Call>
+    double trial(Call& call, long batches) {
+        double sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (long b = 0; b < batches; b++)
+            for (int k = 0; k < batch; k++)
+                sum += call(k);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        sink = sum;
+        return elapsed.count();
+    }
+};
+
+// Rays from a sphere of radius 3 around the origin toward random points of the cube
+// [-1.5, 1.5]^3, so a unit-sized object at the origin is hit by some and missed by others.
+// Times are uniform in [0, 1) for moving objects.
+std::vector<ray> random_rays(int n) {
+    std::vector<ray> rays;
+    rays.reserve(n);
+    for (int k = 0; k < n; k++) {
+        auto origin = 3 * random_unit_vector();
+        auto target = vec3::random(-1.5, 1.5);
+        rays.emplace_back(origin, target - origin, random_double());
+    }
+    return rays;
+}
+
+// Hits of one hittable by every ray of a batch.
+template <typename Hittable>
+void run_hit_kernel(microbench_runner& runner, const std::string& name, const Hittable& object) {
+    auto rays = random_rays(microbench_runner::batch);
+    runner.run(name, [&](int k) {
+        hit_record rec;
+        return object.hit(rays[k], interval(0.001, infinity), rec) ? 1.0 : 0.0;
+    }, true);
+}
+
+// n small spheres scattered through the cube [-1, 1]^3, for the BVHs to be built over.
+hittable_list synthetic_spheres(int n, shared_ptr<material> mat) {
+    hittable_list spheres;
+    double radius = 0.5 / std::cbrt(double(n));
+    for (int k = 0; k < n; k++)
+        spheres.add(make_shared<sphere>(vec3::random(-1, 1), radius, mat));
+    return spheres;
+}
+
+bool parse_options(int argc, char* argv[], microbench_options& options) {
+    for (int k = 1; k < argc; k++) {
+        std::string token = argv[k];
+        if (token == "--help" || token == "-h") {
+            print_usage();
+            std::exit(0);
+        }
+        if (token == "--list") {
+            options.list_only = true;
+            continue;
+        }
+
+        if (k + 1 >= argc) {
+            std::cerr << "Missing value for " << token << ".\n";
+            return false;
+        }
+        std::string value = argv[++k];
+
+        if (token == "--filter")    options.filter = value;
+        else if (token == "--time") options.min_seconds = std::stod(value);
+        else if (token == "--seed") options.seed = std::stoull(value);
+        else {
+            std::cerr << "Unknown option " << token << ".\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    microbench_options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    microbench_runner runner(options);
+    auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+
+    if (runner.selected("aabb_hit")) {
+        aabb box(point3(-1,-1,-1), point3(1,1,1));
+        auto rays = random_rays(microbench_runner::batch);
+        runner.run("aabb_hit", [&](int k) {
+            return box.hit(rays[k], interval(0.001, infinity)) ? 1.0 : 0.0;
+        }, true);
+    }
+
+    if (runner.selected("sphere_hit"))
+        run_hit_kernel(runner, "sphere_hit", sphere(point3(0,0,0), 1, mat));
+    if (runner.selected("sphere_hit_moving"))
+        run_hit_kernel(runner, "sphere_hit_moving",
+                       sphere(point3(-0.25,0,0), point3(0.25,0,0), 1, mat));
+    if (runner.selected("quad_hit"))
+        run_hit_kernel(runner, "quad_hit", quad(point3(-1,-1,0), vec3(2,0,0), vec3(0,2,0), mat));
+    if (runner.selected("tri_hit"))
+        run_hit_kernel(runner, "tri_hit", tri(point3(-1,-1,0), point3(1,-1,0), point3(0,1,0), mat));
+
+    for (int n : {1000, 100000}) {
+        // Every layout is timed on the same spheres and rays.
+        auto inputs = "bvh_hit_" + std::to_string(n);
+        auto name = "bvh_node_hit_" + std::to_string(n);
+        if (runner.selected(name, inputs))
+            run_hit_kernel(runner, name, bvh_node(synthetic_spheres(n, mat)));
+
+        name = "linear_bvh_hit_" + std::to_string(n);
+        if (runner.selected(name, inputs))
+            run_hit_kernel(runner, name, linear_bvh(synthetic_spheres(n, mat)));
+
+        name = "wide4_bvh_hit_" + std::to_string(n);
+        if (runner.selected(name, inputs))
+            run_hit_kernel(runner, name, wide_bvh<4>(synthetic_spheres(n, mat)));
+
+        name = "wide8_bvh_hit_" + std::to_string(n);
+        if (runner.selected(name, inputs))
+            run_hit_kernel(runner, name, wide_bvh<8>(synthetic_spheres(n, mat)));
+    }
+
+    // Spheres moving about as far as they are apart, traced at random times: bounding their
+    // whole motion against bounding them at the ray's time, with 1 and 4 shutter segments.
+    {
+        auto inputs = std::string("moving_bvh_hit");
+        auto moving = [&] {
+            hittable_list spheres;
+            double radius = 0.5 / std::cbrt(10000.0);
+            for (int k = 0; k < 10000; k++) {
+                auto start = vec3::random(-1, 1);
+                spheres.add(make_shared<sphere>(start, start + 0.2 * random_unit_vector(), radius,
+                                                mat));
+            }
+            return spheres;
+        };
+        if (runner.selected("linear_bvh_moving_hit", inputs))
+            run_hit_kernel(runner, "linear_bvh_moving_hit", linear_bvh(moving()));
+
+        bvh_options options = bvh_node::default_options();
+        for (int segments : {1, 4}) {
+            options.motion_segments = segments;
+            auto name = "motion_bvh_" + std::to_string(segments) + "_hit";
+            if (runner.selected(name, inputs))
+                run_hit_kernel(runner, name, motion_bvh(moving(), options));
+        }
+    }
+
+    // A wavy 256x256 height field across the cube: separate tris in a linear_bvh against one
+    // triangle_mesh over shared vertices, in double and in float.
+    {
+        auto inputs = std::string("mesh_hit");
+        const int side = 256;
+        std::vector<point3> vertices;
+        std::vector<uint32_t> faces;
+        for (int i = 0; i < side; i++)
+            for (int j = 0; j < side; j++) {
+                double x = 2.0 * i / (side - 1) - 1, z = 2.0 * j / (side - 1) - 1;
+                vertices.emplace_back(x, 0.2 * std::sin(6 * x) * std::cos(5 * z), z);
+            }
+        for (uint32_t i = 0; i + 1 < side; i++)
+            for (uint32_t j = 0; j + 1 < side; j++) {
+                uint32_t a = i * side + j, b = a + side;
+                faces.insert(faces.end(), {a, b, a + 1, a + 1, b, b + 1});
+            }
+
+        if (runner.selected("linear_bvh_tri_hit", inputs)) {
+            hittable_list tris;
+            for (size_t k = 0; k < faces.size(); k += 3)
+                tris.add(make_shared<tri>(vertices[faces[k]], vertices[faces[k + 1]],
+                                          vertices[faces[k + 2]], mat));
+            run_hit_kernel(runner, "linear_bvh_tri_hit", linear_bvh(std::move(tris)));
+        }
+        if (runner.selected("triangle_mesh_hit", inputs))
+            run_hit_kernel(runner, "triangle_mesh_hit", triangle_mesh(vertices, faces, {mat}));
+        if (runner.selected("float_triangle_mesh_hit", inputs))
+            run_hit_kernel(runner, "float_triangle_mesh_hit",
+                           float_triangle_mesh(vertices, faces, {mat}));
+    }
+
+    if (runner.selected("perlin_noise")) {
+        perlin noise;
+        std::vector<point3> points(microbench_runner::batch);
+        for (auto& p : points)
+            p = vec3::random(0, 16);
+        runner.run("perlin_noise", [&](int k) { return noise.noise(points[k]); });
+    }
+
+    if (runner.selected("perlin_turb_7")) {
+        perlin noise;
+        std::vector<point3> points(microbench_runner::batch);
+        for (auto& p : points)
+            p = vec3::random(0, 16);
+        runner.run("perlin_turb_7", [&](int k) { return noise.turb(points[k], 7); });
+    }
+
+    if (runner.selected("random_unit_vector"))
+        runner.run("random_unit_vector", [](int) { return random_unit_vector().x(); });
+
+    if (runner.selected("image_texture_value")) {
+        image_texture earth("earthmap.jpg");
+        std::vector<std::pair<double, double>> uvs(microbench_runner::batch);
+        for (auto& uv : uvs)
+            uv = {random_double(), random_double()};
+        point3 p(0,0,0);
+        runner.run("image_texture_value", [&](int k) {
+            return earth.value(uvs[k].first, uvs[k].second, p).x();
+        });
+    }
+
+    if (!options.list_only)
+        std::cout << "checksum " << std::setprecision(12) << runner.checksum() << '\n';
+    return 0;
+}
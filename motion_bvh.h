@@ -0,0 +1,237 @@
+#ifndef MOTION_BVH_H
+#define MOTION_BVH_H
+
+#include "linear_bvh.h"
+#include <cstdint>
+#include <vector>
+
+// One node of a motion_bvh: its bounds at the start and end of its time segment, as padded
+// floats like those of linear_bvh_node. 56 bytes.
+struct motion_bvh_node {
+    float    lo0[3], hi0[3];    // At the segment's start
+    float    lo1[3], hi1[3];    // At its end
+    uint32_t offset;            // Interior: index of the second child (the first follows this
+                                // node); leaf: index of the first object
+    uint16_t count;             // Objects in a leaf; 0 for an interior node
+    uint8_t  axis;              // Split axis of an interior node, for near-first traversal
+    uint8_t  pad;
+};
+
+static_assert(sizeof(motion_bvh_node) == 56, "motion_bvh_node should stay packed");
+
+// A BVH for moving objects. Its nodes bound their objects at two times and a ray tests the
+// box interpolated to its own time, rather than the box swept over the whole shutter, so
+// moving objects cost about what static ones do. The interpolated box is conservative because
+// objects move linearly (see hittable::motion_bounds). When objects move far, the shutter can
+// also be split into segments, each with a tree built over the objects' bounds within it; a
+// ray then descends only the tree of the segment its time falls in.
+class motion_bvh : public hittable {
+  public:
+    motion_bvh(hittable_list list, const bvh_options& options = bvh_node::default_options()) {
+        render_stats::scoped_phase timing(render_phase::bvh_build);
+        int segments = std::max(1, options.motion_segments);
+        for (const auto& object : list.objects)
+            bbox = aabb(bbox, object->bounding_box());
+        if (list.objects.empty())
+            return;
+
+        open_box = close_box = aabb::empty;
+        for (const auto& object : list.objects) {
+            aabb open, close;
+            object->motion_bounds(open, close);
+            open_box = aabb(open_box, open);
+            close_box = aabb(close_box, close);
+        }
+
+        for (int s = 0; s < segments; s++)
+            build_segment(list.objects, double(s) / segments, double(s + 1) / segments, options);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (roots.empty())
+            return false;
+
+        // The segment holding the ray's time, and where in it the time falls.
+        int segments = int(roots.size());
+        double scaled = std::fmin(std::fmax(r.time(), 0.0), 1.0) * segments;
+        int segment = std::min(int(scaled), segments - 1);
+        float u = float(scaled - segment);
+
+        const auto& origin = r.origin();
+        const auto& direction = r.direction();
+        double o[3] = {origin.x(), origin.y(), origin.z()};
+        double inv[3] = {1 / direction.x(), 1 / direction.y(), 1 / direction.z()};
+        bool negative[3] = {std::signbit(direction.x()), std::signbit(direction.y()),
+                            std::signbit(direction.z())};
+
+        uint32_t fixed[stack_size];
+        std::vector<uint32_t> heap;
+        uint32_t* stack = fixed;
+        if (depth > stack_size) {
+            heap.resize(depth);
+            stack = heap.data();
+        }
+
+        const auto& objects = segment_objects[segment];
+        bool hit_anything = false;
+        int top = 0;
+        uint32_t index = roots[segment];
+        while (true) {
+            const auto& node = nodes[index];
+            RT_STAT(bvh_nodes);
+            if (box_hit(node, u, o, inv, negative, ray_t)) {
+                if (node.count == 0) {
+                    uint32_t near = index + 1, far = node.offset;
+                    if (negative[node.axis])
+                        std::swap(near, far);
+                    stack[top++] = far;
+                    index = near;
+                    continue;
+                }
+                for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+                    if (objects[k]->hit(r, ray_t, rec)) {
+                        hit_anything = true;
+                        ray_t.max = rec.t;
+                    }
+                }
+            }
+            if (top == 0)
+                break;
+            index = stack[--top];
+        }
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    void motion_bounds(aabb& open, aabb& close) const override {
+        open = open_box;
+        close = close_box;
+    }
+
+    size_t node_count() const { return nodes.size(); }
+
+    // True if any of the objects moves, so a motion_bvh would beat a static BVH over them.
+    static bool has_motion(const hittable_list& list) {
+        for (const auto& object : list.objects) {
+            aabb open, close;
+            object->motion_bounds(open, close);
+            for (int axis = 0; axis < 3; axis++)
+                if (open.axis_interval(axis).min != close.axis_interval(axis).min
+                    || open.axis_interval(axis).max != close.axis_interval(axis).max)
+                    return true;
+        }
+        return false;
+    }
+
+  private:
+    static const int stack_size = 64;
+
+    std::vector<motion_bvh_node> nodes;                 // Every segment's tree, one after another
+    std::vector<uint32_t> roots;                        // Root node of each segment's tree
+    std::vector<std::vector<shared_ptr<hittable>>> segment_objects;     // In each tree's leaf order
+    aabb bbox;
+    aabb open_box, close_box;                           // The objects' bounds at time 0 and 1
+    int depth = 0;                                      // Longest root-to-leaf path of any tree
+
+    // Stands in for an object while a segment's tree is built, with the object's bounds over
+    // the segment, so the splits follow where objects are during it.
+    class segment_proxy : public hittable {
+      public:
+        segment_proxy(shared_ptr<hittable> object, const aabb& box)
+          : object(std::move(object)), box(box) {}
+
+        bool hit(const ray&, interval, hit_record&) const override { return false; }
+        aabb bounding_box() const override { return box; }
+
+        shared_ptr<hittable> object;
+        aabb box;
+    };
+
+    // Builds the tree of the segment [t0, t1] by building a linear_bvh over proxies, then
+    // bounding each of its nodes at both ends of the segment, bottom-up.
+    void build_segment(const std::vector<shared_ptr<hittable>>& objects, double t0, double t1,
+                       const bvh_options& options) {
+        hittable_list proxies;
+        for (const auto& object : objects) {
+            aabb open, close;
+            object->motion_bounds(open, close);
+            proxies.add(make_shared<segment_proxy>(object, lerp(open, close, 0.5 * (t0 + t1))));
+        }
+
+        linear_bvh tree(std::move(proxies), options);
+
+        std::vector<shared_ptr<hittable>> ordered;
+        std::vector<std::pair<aabb, aabb>> leaf_times;
+        ordered.reserve(tree.objects.size());
+        for (const auto& object : tree.objects) {
+            auto proxy = static_cast<const segment_proxy*>(object.get());
+            aabb open, close;
+            proxy->object->motion_bounds(open, close);
+            leaf_times.emplace_back(lerp(open, close, t0), lerp(open, close, t1));
+            ordered.push_back(proxy->object);
+        }
+
+        auto base = uint32_t(nodes.size());
+        roots.push_back(base);
+        nodes.resize(base + tree.nodes.size());
+        for (size_t index = tree.nodes.size(); index-- > 0; ) {
+            const auto& source = tree.nodes[index];
+            auto& node = nodes[base + index];
+            node.count = source.count;
+            node.axis = source.axis;
+            node.pad = 0;
+            if (source.count > 0) {
+                node.offset = source.offset;
+                aabb start = aabb::empty, end = aabb::empty;
+                for (uint32_t k = source.offset; k < source.offset + source.count; k++) {
+                    start = aabb(start, leaf_times[k].first);
+                    end = aabb(end, leaf_times[k].second);
+                }
+                ray_packet::box_bounds(start, node.lo0, node.hi0);
+                ray_packet::box_bounds(end, node.lo1, node.hi1);
+            } else {
+                node.offset = base + source.offset;
+                const auto& first = nodes[base + index + 1];
+                const auto& second = nodes[node.offset];
+                for (int axis = 0; axis < 3; axis++) {
+                    node.lo0[axis] = std::fmin(first.lo0[axis], second.lo0[axis]);
+                    node.hi0[axis] = std::fmax(first.hi0[axis], second.hi0[axis]);
+                    node.lo1[axis] = std::fmin(first.lo1[axis], second.lo1[axis]);
+                    node.hi1[axis] = std::fmax(first.hi1[axis], second.hi1[axis]);
+                }
+            }
+        }
+        segment_objects.push_back(std::move(ordered));
+        depth = std::max(depth, tree.depth);
+    }
+
+    static aabb lerp(const aabb& a, const aabb& b, double t) {
+        auto mix = [t](const interval& x, const interval& y) {
+            return interval((1 - t) * x.min + t * y.min, (1 - t) * x.max + t * y.max);
+        };
+        return aabb(mix(a.x, b.x), mix(a.y, b.y), mix(a.z, b.z));
+    }
+
+    // The slab test of linear_bvh against the node's box at time u of its segment.
+    static bool box_hit(const motion_bvh_node& node, float u, const double o[3],
+                        const double inv[3], const bool negative[3], interval ray_t) {
+        RT_STAT(aabb_tests);
+        for (int axis = 0; axis < 3; axis++) {
+            // In float: its rounding is far below the padding of the stored bounds.
+            float lo = node.lo0[axis] + u * (node.lo1[axis] - node.lo0[axis]);
+            float hi = node.hi0[axis] + u * (node.hi1[axis] - node.hi0[axis]);
+            double t0 = (lo - o[axis]) * inv[axis];
+            double t1 = (hi - o[axis]) * inv[axis];
+            if (negative[axis])
+                std::swap(t0, t1);
+            if (t0 > ray_t.min) ray_t.min = t0;
+            if (t1 < ray_t.max) ray_t.max = t1;
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
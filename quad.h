@@ -14,6 +14,8 @@ class quad : public hittable {
         D = dot(normal, Q);
         w = n / dot(n, n);
 
+        area = n.length();
+
         set_bounding_box();
     }
 
@@ -27,6 +29,7 @@ class quad : public hittable {
     aabb bounding_box() const override { return bbox; }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_STAT(quad_tests);
         auto denom = dot(normal, r.direction());
 
         // No hit if the ray is parallel to the plane.
@@ -51,12 +54,30 @@ class quad : public hittable {
 
         rec.t = t;
         rec.p = intersection;
-        rec.mat = mat;
+        rec.mat = mat.get();
         rec.set_face_normal(r, normal);
 
+        RT_STAT(quad_hits);
         return true;
     }
 
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        hit_record rec;
+        if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+            return 0;
+
+        // Convert the uniform area density to solid angle at origin.
+        auto distance_squared = rec.t * rec.t * direction.length_squared();
+        auto cosine = std::fabs(dot(direction, rec.normal) / direction.length());
+
+        return distance_squared / (cosine * area);
+    }
+
+    vec3 random(const point3& origin) const override {
+        auto p = Q + (random_double() * u) + (random_double() * v);
+        return p - origin;
+    }
+
     virtual bool is_interior(double a, double b, hit_record& rec) const {
         interval unit_interval = interval(0, 1);
         if (!unit_interval.contains(a) || !unit_interval.contains(b))
@@ -75,6 +96,7 @@ class quad : public hittable {
 
     vec3 normal;
     double D;
+    double area;
 };
 
 inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat)
@@ -0,0 +1,169 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "rtweekend.h"
+#include "AABB.h"
+
+#if defined(__AVX__)
+#define RT_PACKET_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_PACKET_SSE
+#include <emmintrin.h>
+#endif
+
+// Up to 16 coherent rays traced together. Alongside the exact double-precision rays, the packet
+// keeps single-precision copies of origins, inverse directions and current far distances in
+// structure-of-arrays form, so one box test covers 4 (SSE) or 8 (AVX) rays per instruction.
+// Rays are addressed by bit in a 32-bit mask.
+struct ray_packet {
+    static const int max_size = 16;
+
+    int size = 0;
+    ray rays[max_size];
+    double tmin = 0.001;
+    double tmax[max_size];
+    rng_stream rng[max_size];   // Each ray's random stream, swapped in whenever it is traced alone
+
+    alignas(32) float ox[max_size], oy[max_size], oz[max_size];
+    alignas(32) float idx[max_size], idy[max_size], idz[max_size];
+    alignas(32) float ex[max_size], ey[max_size], ez[max_size];    // Slab errors (see slab_error)
+    alignas(32) float tfar[max_size];
+
+    ray_packet() { clear(); }
+
+    void clear() {
+        size = 0;
+        for (int k = 0; k < max_size; k++) {
+            ox[k] = oy[k] = oz[k] = 0;
+            idx[k] = idy[k] = idz[k] = 1;
+            ex[k] = ey[k] = ez[k] = 0;
+            tfar[k] = -1;       // Unused lanes miss every box
+        }
+    }
+
+    uint32_t all() const { return size >= 32 ? ~0u : (1u << size) - 1; }
+
+    int add(const ray& r) {
+        int k = size++;
+        rays[k] = r;
+        ox[k] = float(r.origin().x());
+        oy[k] = float(r.origin().y());
+        oz[k] = float(r.origin().z());
+        idx[k] = float(1.0 / r.direction().x());
+        idy[k] = float(1.0 / r.direction().y());
+        idz[k] = float(1.0 / r.direction().z());
+        ex[k] = slab_error(r.origin().x(), idx[k]);
+        ey[k] = slab_error(r.origin().y(), idy[k]);
+        ez[k] = slab_error(r.origin().z(), idz[k]);
+        set_tmax(k, infinity);
+        return k;
+    }
+
+    void set_tmax(int k, double t) {
+        // Round the float copy up so the box test stays conservative.
+        tmax[k] = t;
+        tfar[k] = std::isinf(t) ? std::numeric_limits<float>::infinity()
+                                : float(t) * (1 + 1e-6f) + 1e-6f;
+    }
+
+    static int count(uint32_t mask) {
+        int n = 0;
+        for (; mask; mask &= mask - 1) n++;
+        return n;
+    }
+
+    // Returns the rays of mask whose current interval overlaps the box, given as float bounds
+    // already padded outward (see box_bounds). May report extra hits but never misses one.
+    uint32_t box_hit(const float lo[3], const float hi[3], uint32_t mask) const {
+        uint32_t result = 0;
+#if defined(RT_PACKET_AVX)
+        for (int base = 0; base < size; base += 8) {
+            if (((mask >> base) & 0xff) == 0) continue;
+            __m256 tnear = _mm256_setzero_ps();
+            __m256 tfar_v = _mm256_load_ps(tfar + base);
+            slab(_mm256_set1_ps(lo[0]), _mm256_set1_ps(hi[0]), _mm256_load_ps(ox + base),
+                 _mm256_load_ps(idx + base), _mm256_load_ps(ex + base), tnear, tfar_v);
+            slab(_mm256_set1_ps(lo[1]), _mm256_set1_ps(hi[1]), _mm256_load_ps(oy + base),
+                 _mm256_load_ps(idy + base), _mm256_load_ps(ey + base), tnear, tfar_v);
+            slab(_mm256_set1_ps(lo[2]), _mm256_set1_ps(hi[2]), _mm256_load_ps(oz + base),
+                 _mm256_load_ps(idz + base), _mm256_load_ps(ez + base), tnear, tfar_v);
+            auto hit = _mm256_cmp_ps(tnear, tfar_v, _CMP_LE_OQ);
+            result |= uint32_t(_mm256_movemask_ps(hit)) << base;
+        }
+#elif defined(RT_PACKET_SSE)
+        for (int base = 0; base < size; base += 4) {
+            if (((mask >> base) & 0xf) == 0) continue;
+            __m128 tnear = _mm_setzero_ps();
+            __m128 tfar_v = _mm_load_ps(tfar + base);
+            slab(_mm_set1_ps(lo[0]), _mm_set1_ps(hi[0]), _mm_load_ps(ox + base),
+                 _mm_load_ps(idx + base), _mm_load_ps(ex + base), tnear, tfar_v);
+            slab(_mm_set1_ps(lo[1]), _mm_set1_ps(hi[1]), _mm_load_ps(oy + base),
+                 _mm_load_ps(idy + base), _mm_load_ps(ey + base), tnear, tfar_v);
+            slab(_mm_set1_ps(lo[2]), _mm_set1_ps(hi[2]), _mm_load_ps(oz + base),
+                 _mm_load_ps(idz + base), _mm_load_ps(ez + base), tnear, tfar_v);
+            result |= uint32_t(_mm_movemask_ps(_mm_cmple_ps(tnear, tfar_v))) << base;
+        }
+#else
+        const float* o[3]   = {ox, oy, oz};
+        const float* inv[3] = {idx, idy, idz};
+        const float* err[3] = {ex, ey, ez};
+        for (int k = 0; k < size; k++) {
+            if (!(mask & (1u << k))) continue;
+            float tnear = 0, tf = tfar[k];
+            for (int axis = 0; axis < 3; axis++) {
+                float t0 = (lo[axis] - o[axis][k]) * inv[axis][k];
+                float t1 = (hi[axis] - o[axis][k]) * inv[axis][k];
+                tnear = std::fmax(tnear, std::fmin(t0, t1) - err[axis][k]);
+                tf = std::fmin(tf, std::fmax(t0, t1) + err[axis][k]);
+            }
+            if (tnear <= tf) result |= 1u << k;
+        }
+#endif
+        return result & mask;
+    }
+
+    // Converts a box to float bounds padded by enough to cover the float rounding of the box,
+    // and of the slab arithmetic for origins near it. Far origins need slab_error as well.
+    static void box_bounds(const aabb& box, float lo[3], float hi[3]) {
+        for (int axis = 0; axis < 3; axis++) {
+            const auto& range = box.axis_interval(axis);
+            double pad = 1e-5 * (std::fmax(std::fabs(range.min), std::fabs(range.max))
+                                 + range.size()) + 1e-5;
+            lo[axis] = float(range.min - pad);
+            hi[axis] = float(range.max + pad);
+        }
+    }
+
+    // How far the float slab distances along one axis can be off for a ray with origin
+    // coordinate o and float inverse direction inv: rounding o to float, and the subtraction,
+    // inverse and product that follow, each err by half a float ulp of a term up to |o|, so
+    // 2^-21 |o inv| covers them with room to spare. Box padding covers the box's own share; this
+    // covers the origin's, which dominates when it is far from the box. Capped so that adding
+    // it to an infinite distance never gives NaN.
+    static float slab_error(double o, float inv) {
+        double e = std::ldexp(std::fabs(o) * std::fabs(double(inv)), -21);
+        return float(std::fmin(e, double(std::numeric_limits<float>::max())));
+    }
+
+  private:
+#if defined(RT_PACKET_AVX)
+    static void slab(__m256 lo, __m256 hi, __m256 o, __m256 inv, __m256 err, __m256& tnear,
+                     __m256& tfar) {
+        auto t0 = _mm256_mul_ps(_mm256_sub_ps(lo, o), inv);
+        auto t1 = _mm256_mul_ps(_mm256_sub_ps(hi, o), inv);
+        tnear = _mm256_max_ps(tnear, _mm256_sub_ps(_mm256_min_ps(t0, t1), err));
+        tfar  = _mm256_min_ps(tfar,  _mm256_add_ps(_mm256_max_ps(t0, t1), err));
+    }
+#elif defined(RT_PACKET_SSE)
+    static void slab(__m128 lo, __m128 hi, __m128 o, __m128 inv, __m128 err, __m128& tnear,
+                     __m128& tfar) {
+        auto t0 = _mm_mul_ps(_mm_sub_ps(lo, o), inv);
+        auto t1 = _mm_mul_ps(_mm_sub_ps(hi, o), inv);
+        tnear = _mm_max_ps(tnear, _mm_sub_ps(_mm_min_ps(t0, t1), err));
+        tfar  = _mm_min_ps(tfar,  _mm_add_ps(_mm_max_ps(t0, t1), err));
+    }
+#endif
+};
+
+#endif
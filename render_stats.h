@@ -0,0 +1,310 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Render statistics: path lengths and endings (always gathered), intersection counters (only
+// when built with -DRT_STATS), and wall time per phase.
+
+// Path length and termination counts for a render, gathered per tile and merged.
+struct path_stats {
+    enum ending { missed, absorbed, roulette, depth_limit, ending_count };
+    static const int histogram_bins = 65;       // Lengths 0-63, then 64 or more
+
+    long long paths = 0;
+    long long segments = 0;                     // Rays traced, summed over all paths
+    long long shadow_rays = 0;                  // Next-event estimation rays toward the lights
+    long long endings[ending_count] = {};
+    long long lengths[histogram_bins] = {};
+
+    void record(int path_segments, ending why) {
+        paths++;
+        segments += path_segments;
+        endings[why]++;
+        lengths[std::min(path_segments, histogram_bins - 1)]++;
+    }
+
+    void merge(const path_stats& other) {
+        paths += other.paths;
+        segments += other.segments;
+        shadow_rays += other.shadow_rays;
+        for (int k = 0; k < ending_count; k++)
+            endings[k] += other.endings[k];
+        for (int k = 0; k < histogram_bins; k++)
+            lengths[k] += other.lengths[k];
+    }
+
+    static const char* ending_name(int k) {
+        static const char* names[ending_count] = {
+            "missed the scene", "absorbed or hit a light", "Russian roulette", "depth limit"
+        };
+        return names[k];
+    }
+
+    std::string summary() const {
+        std::ostringstream out;
+        out << "Paths: " << paths << ", average length " << double(segments) / std::max(1LL, paths)
+            << " rays\n";
+        for (int k = 0; k < ending_count; k++)
+            out << "  " << ending_name(k) << ": " << 100.0 * endings[k] / std::max(1LL, paths) << "%\n";
+        return out.str();
+    }
+};
+
+// Intersection counters. Each thread increments its own block, so counting needs no atomic
+// read-modify-write; totals are summed over every block on demand.
+enum class render_counter {
+    bvh_nodes, aabb_tests, packet_box_tests,
+    sphere_tests, sphere_hits, quad_tests, quad_hits, tri_tests, tri_hits,
+    medium_tests, medium_samples, medium_hits,
+    count
+};
+
+// Wall-time phases, timed per thread: a render's report reads the phases of the thread that
+// built its scene and called render.
+enum class render_phase { scene_build, bvh_build, render, denoise, output, count };
+
+#ifdef RT_STATS
+#define RT_STAT(name) render_stats::bump(render_counter::name, 1)
+#define RT_STAT_ADD(name, n) render_stats::bump(render_counter::name, (n))
+#else
+#define RT_STAT(name) ((void)0)
+#define RT_STAT_ADD(name, n) ((void)0)
+#endif
+
+class render_stats {
+  public:
+    static const int counter_count = int(render_counter::count);
+    static const int phase_count = int(render_phase::count);
+
+    using counters = std::array<uint64_t, counter_count>;
+
+#ifdef RT_STATS
+    static const bool counters_enabled = true;
+#else
+    static const bool counters_enabled = false;
+#endif
+
+    static void bump(render_counter c, uint64_t n) {
+        // Only this thread writes its block; relaxed load and store keep concurrent snapshots
+        // well defined without a locked add.
+        auto& value = local_block()[int(c)];
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // The calling thread's own count so far.
+    static uint64_t local_count(render_counter c) {
+        return local_block()[int(c)].load(std::memory_order_relaxed);
+    }
+
+    // Current totals over every thread that has counted anything.
+    static counters snapshot() {
+        counters total{};
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const auto& b : r.blocks)
+            for (int k = 0; k < counter_count; k++)
+                total[k] += (*b)[k].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    static counters difference(const counters& later, const counters& earlier) {
+        counters d{};
+        for (int k = 0; k < counter_count; k++)
+            d[k] = later[k] - earlier[k];
+        return d;
+    }
+
+    static double& phase_seconds(render_phase p) {
+        static thread_local double seconds[phase_count] = {};
+        return seconds[int(p)];
+    }
+
+    static void reset_phases() {
+        for (int k = 0; k < phase_count; k++)
+            phase_seconds(render_phase(k)) = 0;
+    }
+
+    // Adds the lifetime of the object to a phase. Nested timers of the same phase on one thread
+    // (a BVH build inside another) count only once, through the outermost.
+    class scoped_phase {
+      public:
+        explicit scoped_phase(render_phase p)
+          : phase(p), outermost(depth(p)++ == 0), start(std::chrono::steady_clock::now()) {}
+
+        ~scoped_phase() {
+            depth(phase)--;
+            if (outermost) {
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                phase_seconds(phase) += elapsed.count();
+            }
+        }
+
+        scoped_phase(const scoped_phase&) = delete;
+        scoped_phase& operator=(const scoped_phase&) = delete;
+
+      private:
+        render_phase phase;
+        bool outermost;
+        std::chrono::steady_clock::time_point start;
+
+        static int& depth(render_phase p) {
+            static thread_local int depths[phase_count] = {};
+            return depths[int(p)];
+        }
+    };
+
+  private:
+    using block = std::array<std::atomic<uint64_t>, counter_count>;
+
+    struct block_registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<block>> blocks;     // Kept after their threads exit
+    };
+
+    static block_registry& registry() {
+        static block_registry r;
+        return r;
+    }
+
+    static block& local_block() {
+        static thread_local block* mine = [] {
+            auto b = std::make_unique<block>();
+            for (auto& value : *b)
+                value.store(0, std::memory_order_relaxed);
+            auto& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.blocks.push_back(std::move(b));
+            return r.blocks.back().get();
+        }();
+        return *mine;
+    }
+};
+
+// Everything known about one finished render, printed as a summary and written as JSON.
+struct render_report {
+    std::string output_filename;
+    int image_width = 0, image_height = 0, samples_per_pixel = 0;
+    path_stats paths;
+    render_stats::counters counters{};
+    double phases[render_stats::phase_count] = {};
+
+    double phase(render_phase p) const { return phases[int(p)]; }
+    uint64_t count(render_counter c) const { return counters[int(c)]; }
+
+    // Scene rays (camera rays and bounces) plus shadow rays.
+    uint64_t rays() const { return uint64_t(paths.segments + paths.shadow_rays); }
+
+    double rays_per_second() const {
+        auto seconds = phase(render_phase::render);
+        return seconds > 0 ? rays() / seconds : 0;
+    }
+
+    std::string summary() const {
+        std::ostringstream out;
+        out << "Time: scene build " << phase(render_phase::scene_build) << "s (BVH "
+            << phase(render_phase::bvh_build) << "s), render " << phase(render_phase::render) << "s";
+        if (phase(render_phase::denoise) > 0)
+            out << ", denoise " << phase(render_phase::denoise) << "s";
+        out << "\nRays: " << rays() << " (" << rays_per_second() / 1e6 << " M/s)\n";
+
+        if (!render_stats::counters_enabled) {
+            out << "Intersection counters disabled (build with -DRT_STATS)\n";
+            return out.str();
+        }
+        out << "BVH: " << count(render_counter::bvh_nodes) << " node visits, "
+            << per_ray(count(render_counter::bvh_nodes)) << " per ray, "
+            << count(render_counter::aabb_tests) << " box tests, "
+            << count(render_counter::packet_box_tests) << " packet box tests\n";
+        for (const auto& p : primitive_rows())
+            out << "  " << p.name << ": " << p.tests << " tests, " << p.hits << " hits\n";
+        out << "  constant_medium: " << count(render_counter::medium_samples)
+            << " distance samples, " << count(render_counter::medium_hits) << " scatters\n";
+        return out.str();
+    }
+
+    std::string json() const {
+        std::ostringstream out;
+        out << "{\n"
+            << "  \"output\": \"" << escape(output_filename) << "\",\n"
+            << "  \"image\": {\"width\": " << image_width << ", \"height\": " << image_height
+            << ", \"samples_per_pixel\": " << samples_per_pixel << "},\n"
+            << "  \"phases_seconds\": {";
+        static const char* phase_names[render_stats::phase_count] = {
+            "scene_build", "bvh_build", "render", "denoise", "output"
+        };
+        for (int k = 0; k < render_stats::phase_count; k++)
+            out << (k ? ", " : "") << '"' << phase_names[k] << "\": " << phases[k];
+        out << "},\n"
+            << "  \"rays\": {\"scene\": " << paths.segments << ", \"shadow\": "
+            << paths.shadow_rays << ", \"per_second\": " << rays_per_second()
+            << "},\n"
+            << "  \"paths\": {\"count\": " << paths.paths << ", \"average_length\": "
+            << double(paths.segments) / std::max(1LL, paths.paths) << ", \"endings\": {";
+        static const char* ending_keys[path_stats::ending_count] = {
+            "missed", "absorbed", "roulette", "depth_limit"
+        };
+        for (int k = 0; k < path_stats::ending_count; k++)
+            out << (k ? ", " : "") << '"' << ending_keys[k] << "\": " << paths.endings[k];
+        out << "},\n    \"length_histogram\": [";
+        int last = path_stats::histogram_bins - 1;
+        while (last > 0 && paths.lengths[last] == 0) last--;
+        for (int k = 0; k <= last; k++)
+            out << (k ? ", " : "") << paths.lengths[k];
+        out << "]},\n"
+            << "  \"counters_enabled\": " << (render_stats::counters_enabled ? "true" : "false");
+        if (render_stats::counters_enabled) {
+            out << ",\n  \"bvh\": {\"node_visits\": " << count(render_counter::bvh_nodes)
+                << ", \"nodes_per_ray\": " << per_ray(count(render_counter::bvh_nodes))
+                << ", \"aabb_tests\": " << count(render_counter::aabb_tests)
+                << ", \"packet_box_tests\": " << count(render_counter::packet_box_tests) << "},\n"
+                << "  \"primitives\": {";
+            for (const auto& p : primitive_rows())
+                out << '"' << p.name << "\": {\"tests\": " << p.tests << ", \"hits\": " << p.hits
+                    << "}, ";
+            out << "\"constant_medium\": {\"tests\": " << count(render_counter::medium_tests)
+                << ", \"samples\": " << count(render_counter::medium_samples)
+                << ", \"hits\": " << count(render_counter::medium_hits) << "}}";
+        }
+        out << "\n}\n";
+        return out.str();
+    }
+
+  private:
+    struct primitive_row {
+        const char* name;
+        uint64_t tests, hits;
+    };
+
+    std::vector<primitive_row> primitive_rows() const {
+        return {
+            {"sphere", count(render_counter::sphere_tests), count(render_counter::sphere_hits)},
+            {"quad",   count(render_counter::quad_tests),   count(render_counter::quad_hits)},
+            {"tri",    count(render_counter::tri_tests),    count(render_counter::tri_hits)},
+        };
+    }
+
+    double per_ray(uint64_t n) const {
+        return rays() > 0 ? double(n) / rays() : 0;
+    }
+
+    static std::string escape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out;
+    }
+};
+
+#endif
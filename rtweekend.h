@@ -2,11 +2,11 @@
 #define GRAPHICS_PROJECT_RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
 #include <memory>
-#include <random>
 
 
 // C++ Std Usings
@@ -25,9 +25,64 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// Random Numbers
+//
+// Every thread draws from its own PCG32 stream, so there is no shared generator state. The
+// renderer reseeds the stream from (seed, pixel, sample) before tracing each sample, so a pixel
+// gets the same random numbers no matter which thread renders it or in what order.
+
+class rng_stream {
+  public:
+    rng_stream() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+
+    void seed(uint64_t initstate, uint64_t sequence) {
+        state = 0;
+        inc = (sequence << 1) | 1;
+        next_uint();
+        state += initstate;
+        next_uint();
+    }
+
+    // Seeds from a tuple of counters. The counters are hashed, so neighbouring pixels and
+    // samples still get uncorrelated streams.
+    void seed(uint64_t key, uint64_t a, uint64_t b) {
+        seed(mix(key ^ mix(a)), mix(b + 0x9e3779b97f4a7c15ULL));
+    }
+
+    uint32_t next_uint() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        auto xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        auto rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+    }
+
+    double next_double() {
+        // Returns a random real in [0,1).
+        return next_uint() * (1.0 / 4294967296.0);
+    }
+
+    static uint64_t mix(uint64_t x) {
+        // SplitMix64 finalizer.
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+  private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+inline rng_stream& thread_rng() {
+    static thread_local rng_stream rng;
+    return rng;
+}
+
 inline double random_double() {
     // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    return thread_rng().next_double();
 }
 
 inline double random_double(double min, double max) {
@@ -40,15 +95,9 @@ inline int random_int(int min, int max) {
     return int(random_double(min, max+1));
 }
 
-inline double random_double_alt() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
-}
-
-
 // Common Headers
 
+#include "render_stats.h"
 #include "color.h"
 #include "ray.h"
 #include "vec3.h"
@@ -0,0 +1,352 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Pluggable sources of the random numbers behind a camera sample. A sampler hands out values one
+// dimension at a time (pixel jitter, lens, time, then a block per bounce), so each kind can spread
+// a pixel's samples evenly across every dimension instead of drawing them independently.
+
+enum class sampler_type { independent, stratified, sobol, blue_noise };
+
+struct sample2 {
+    double u, v;
+};
+
+class sampler {
+  public:
+    virtual ~sampler() = default;
+
+    // Starts sample number index of pixel (i, j), at dimension 0.
+    void start_sample(int i, int j, int index) {
+        px = i;
+        py = j;
+        sample_index = uint32_t(index);
+        dimension = 0;
+    }
+
+    // Jumps to a fixed dimension, so each bounce reads the same dimensions in every sample.
+    void set_dimension(int d) { dimension = d; }
+
+    double get_1d() {
+        return sample_1d(dimension++);
+    }
+
+    sample2 get_2d() {
+        auto s = sample_2d(dimension);
+        dimension += 2;
+        return s;
+    }
+
+  protected:
+    int px = 0, py = 0;
+    uint32_t sample_index = 0;
+    int dimension = 0;
+
+    virtual double sample_1d(int dim) = 0;
+    virtual sample2 sample_2d(int dim) = 0;
+
+    // A well-mixed 32-bit hash of the pixel and dimension, for per-pixel scrambling seeds.
+    uint32_t pixel_hash(uint64_t seed, int dim) const {
+        auto key = (uint64_t(uint32_t(px)) << 32) | uint32_t(py);
+        return uint32_t(rng_stream::mix(seed ^ rng_stream::mix(key ^ rng_stream::mix(uint64_t(dim)))));
+    }
+
+    static double to_unit(uint32_t bits) {
+        // Maps 32 bits to [0,1), staying strictly below 1.
+        return std::min(bits * (1.0 / 4294967296.0), 0x1.fffffffffffffp-1);
+    }
+};
+
+// Plain uniform random numbers from the per-sample thread stream.
+class independent_sampler : public sampler {
+  protected:
+    double sample_1d(int) override { return random_double(); }
+    sample2 sample_2d(int) override { return {random_double(), random_double()}; }
+};
+
+// Jittered stratification: the pixel's samples_per_pixel samples each get their own stratum of
+// every 1D dimension and their own cell of a near-square grid for every 2D dimension. The
+// stratum a sample lands in is a per-pixel, per-dimension hashed permutation of its index, so the
+// dimensions stay decorrelated from one another.
+class stratified_sampler : public sampler {
+  public:
+    stratified_sampler(int samples_per_pixel, uint64_t seed)
+      : count(std::max(1, samples_per_pixel)), seed(seed)
+    {
+        grid_x = std::max(1, int(std::sqrt(double(count))));
+        grid_y = (count + grid_x - 1) / grid_x;
+    }
+
+  protected:
+    double sample_1d(int dim) override {
+        uint32_t stratum = permute(sample_index % count, count, pixel_hash(seed, dim));
+        return (stratum + random_double()) / count;
+    }
+
+    sample2 sample_2d(int dim) override {
+        uint32_t cells = uint32_t(grid_x * grid_y);
+        uint32_t cell = permute(sample_index % cells, cells, pixel_hash(seed, dim));
+        return {((cell % grid_x) + random_double()) / grid_x,
+                ((cell / grid_x) + random_double()) / grid_y};
+    }
+
+  private:
+    int count;
+    int grid_x, grid_y;
+    uint64_t seed;
+
+    static uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+        // Kensler's hashed permutation of [0, l) ("Correlated Multi-Jittered Sampling", 2013).
+        uint32_t w = l - 1;
+        w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+        do {
+            i ^= p;             i *= 0xe170893d;
+            i ^= p >> 16;       i ^= (i & w) >> 4;
+            i ^= p >> 8;        i *= 0x0929eb3f;
+            i ^= p >> 23;       i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;   i *= 0x6935fa69;
+            i ^= (i & w) >> 11; i *= 0x74dcb303;
+            i ^= (i & w) >> 2;  i *= 0x9e501cc3;
+            i ^= (i & w) >> 2;  i *= 0xc860a3df;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= l);
+        return (i + p) % l;
+    }
+};
+
+// Owen-scrambled Sobol points, padded across dimensions: every 1D or 2D dimension reads the first
+// one or two Sobol dimensions under its own index shuffle and scramble (Burley, "Practical
+// Hash-based Owen Scrambling", 2020). Any prefix of a pixel's samples is well distributed, which
+// suits adaptive sampling and checkpointed passes.
+class sobol_sampler : public sampler {
+  public:
+    explicit sobol_sampler(uint64_t seed) : seed(seed) {}
+
+    static uint32_t sobol(uint32_t index, int dim) {
+        // Dimension 0 is the van der Corput sequence; dimension 1 uses the direction numbers of
+        // the primitive polynomial x + 1.
+        static const auto directions = [] {
+            std::vector<uint32_t> v(32);
+            v[0] = 1u << 31;
+            for (int i = 1; i < 32; i++)
+                v[i] = v[i-1] ^ (v[i-1] >> 1);
+            return v;
+        }();
+
+        if (dim == 0)
+            return reverse_bits(index);
+
+        uint32_t x = 0;
+        for (int bit = 0; index; index >>= 1, bit++)
+            if (index & 1)
+                x ^= directions[bit];
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverse_bits(x);
+    }
+
+    static uint32_t reverse_bits(uint32_t x) {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+  protected:
+    uint64_t seed;
+
+    virtual uint32_t dimension_seed(int dim) const { return pixel_hash(seed, dim); }
+
+    double sample_1d(int dim) override {
+        uint32_t s = dimension_seed(dim);
+        uint32_t index = nested_uniform_scramble(sample_index, s);
+        return to_unit(nested_uniform_scramble(sobol(index, 0), s ^ 0xa511e9b3u));
+    }
+
+    sample2 sample_2d(int dim) override {
+        uint32_t s = dimension_seed(dim);
+        uint32_t index = nested_uniform_scramble(sample_index, s);
+        return {to_unit(nested_uniform_scramble(sobol(index, 0), s ^ 0xa511e9b3u)),
+                to_unit(nested_uniform_scramble(sobol(index, 1), s ^ 0x63d83595u))};
+    }
+};
+
+// Every pixel uses the same scrambled Sobol points, toroidally shifted by a value read from a
+// blue-noise mask (Georgiev and Fajardo, "Blue-noise Dithered Sampling", 2016). Neighbouring
+// pixels then get well-separated offsets, so the remaining error is spread as high-frequency
+// noise that looks smoother at low sample counts and is easy to filter.
+class blue_noise_sampler : public sobol_sampler {
+  public:
+    explicit blue_noise_sampler(uint64_t seed) : sobol_sampler(seed) {}
+
+    // A 64x64 blue-noise rank mask with values in [0,1), made once by void-and-cluster.
+    static const std::vector<float>& mask() {
+        static const std::vector<float> values = make_mask();
+        return values;
+    }
+
+  protected:
+    // All pixels share the dimension's scramble; only the mask offset differs between them.
+    uint32_t dimension_seed(int dim) const override {
+        return uint32_t(rng_stream::mix(seed ^ rng_stream::mix(uint64_t(dim))));
+    }
+
+    double sample_1d(int dim) override {
+        return rotate(sobol_sampler::sample_1d(dim), mask_value(dim, 0));
+    }
+
+    sample2 sample_2d(int dim) override {
+        auto s = sobol_sampler::sample_2d(dim);
+        return {rotate(s.u, mask_value(dim, 0)), rotate(s.v, mask_value(dim, 1))};
+    }
+
+  private:
+    static const int mask_size = 64;
+
+    double mask_value(int dim, int component) const {
+        // Each dimension reads the mask at its own toroidal offset, which keeps dimensions
+        // decorrelated while preserving the blue-noise spectrum across the image.
+        auto h = rng_stream::mix(seed ^ uint64_t(dim * 2 + component + 1));
+        int ox = int(h & (mask_size - 1));
+        int oy = int((h >> 8) & (mask_size - 1));
+        int x = (px + ox) & (mask_size - 1);
+        int y = (py + oy) & (mask_size - 1);
+        return mask()[size_t(y) * mask_size + x];
+    }
+
+    static double rotate(double x, double offset) {
+        x += offset;
+        return x >= 1.0 ? x - 1.0 : x;
+    }
+
+    static std::vector<float> make_mask() {
+        // Void-and-cluster (Ulichney 1993) with a toroidal Gaussian energy filter.
+        const int n = mask_size * mask_size;
+        const double sigma = 1.5;
+
+        std::vector<double> filter(n);
+        for (int y = 0; y < mask_size; y++) {
+            for (int x = 0; x < mask_size; x++) {
+                int dx = std::min(x, mask_size - x);
+                int dy = std::min(y, mask_size - y);
+                filter[size_t(y) * mask_size + x] = std::exp(-(dx*dx + dy*dy) / (2 * sigma * sigma));
+            }
+        }
+
+        std::vector<char> pattern(n, 0);
+        std::vector<double> energy(n, 0.0);
+        auto splat = [&](std::vector<double>& e, int p, double sign) {
+            int px = p % mask_size, py = p / mask_size;
+            for (int y = 0; y < mask_size; y++) {
+                int fy = ((y - py) & (mask_size - 1)) * mask_size;
+                for (int x = 0; x < mask_size; x++)
+                    e[size_t(y) * mask_size + x] += sign * filter[fy + ((x - px) & (mask_size - 1))];
+            }
+        };
+        // Tightest cluster: the set pixel with the highest energy. Largest void: the empty pixel
+        // with the lowest.
+        auto tightest_cluster = [&](const std::vector<double>& e, char value) {
+            int best = -1;
+            for (int p = 0; p < n; p++)
+                if (pattern[p] == value && (best < 0 || e[p] > e[best])) best = p;
+            return best;
+        };
+        auto largest_void = [&](const std::vector<double>& e, char value) {
+            int best = -1;
+            for (int p = 0; p < n; p++)
+                if (pattern[p] == value && (best < 0 || e[p] < e[best])) best = p;
+            return best;
+        };
+
+        // Initial binary pattern: a random tenth of the pixels, relaxed until the tightest
+        // cluster and the largest void coincide.
+        rng_stream rng;
+        rng.seed(0x5eed, 0);
+        int ones = n / 10;
+        for (int placed = 0; placed < ones; ) {
+            int p = int(rng.next_uint() % n);
+            if (pattern[p]) continue;
+            pattern[p] = 1;
+            splat(energy, p, +1);
+            placed++;
+        }
+        while (true) {
+            int cluster = tightest_cluster(energy, 1);
+            pattern[cluster] = 0;
+            splat(energy, cluster, -1);
+            int void_pixel = largest_void(energy, 0);
+            if (void_pixel == cluster) {
+                pattern[cluster] = 1;
+                splat(energy, cluster, +1);
+                break;
+            }
+            pattern[void_pixel] = 1;
+            splat(energy, void_pixel, +1);
+        }
+
+        std::vector<int> rank(n, 0);
+        auto initial_pattern = pattern;
+        auto initial_energy = energy;
+
+        // Phase 1: rank the initial points by repeatedly removing the tightest cluster.
+        for (int r = ones - 1; r >= 0; r--) {
+            int cluster = tightest_cluster(energy, 1);
+            pattern[cluster] = 0;
+            splat(energy, cluster, -1);
+            rank[cluster] = r;
+        }
+
+        // Phase 2: fill the largest voids up to half the pixels.
+        pattern = initial_pattern;
+        energy = initial_energy;
+        for (int r = ones; r < n / 2; r++) {
+            int void_pixel = largest_void(energy, 0);
+            pattern[void_pixel] = 1;
+            splat(energy, void_pixel, +1);
+            rank[void_pixel] = r;
+        }
+
+        // Phase 3: past half, the empty pixels are the minority, so rank them by repeatedly
+        // filling the tightest cluster of empty pixels.
+        std::vector<double> empty_energy(n, 0.0);
+        for (int p = 0; p < n; p++)
+            if (!pattern[p]) splat(empty_energy, p, +1);
+        for (int r = n / 2; r < n; r++) {
+            int cluster = tightest_cluster(empty_energy, 0);
+            pattern[cluster] = 1;
+            splat(empty_energy, cluster, -1);
+            rank[cluster] = r;
+        }
+
+        std::vector<float> values(n);
+        for (int p = 0; p < n; p++)
+            values[p] = (rank[p] + 0.5f) / n;
+        return values;
+    }
+};
+
+inline std::unique_ptr<sampler> make_sampler(sampler_type type, int samples_per_pixel, uint64_t seed) {
+    switch (type) {
+        case sampler_type::stratified: return std::make_unique<stratified_sampler>(samples_per_pixel, seed);
+        case sampler_type::sobol:      return std::make_unique<sobol_sampler>(seed);
+        case sampler_type::blue_noise: return std::make_unique<blue_noise_sampler>(seed);
+        default:                       return std::make_unique<independent_sampler>();
+    }
+}
+
+#endif
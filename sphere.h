@@ -2,6 +2,7 @@
 #define GRAPHICS_PROJECT_SPHERE_H
 
 #include "hittable.h"
+#include "onb.h"
 #include "rtweekend.h"
 #include <iostream>
 
@@ -29,6 +30,7 @@ class sphere : public hittable {
 
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            RT_STAT(sphere_tests);
             point3 current_center = center.at(r.time());
             vec3 oc = current_center - r.origin();
             auto a = r.direction().length_squared();
@@ -55,8 +57,9 @@ class sphere : public hittable {
             vec3 outward_normal = (rec.p - current_center) / radius;
             rec.set_face_normal(r, outward_normal);
             get_sphere_uv(outward_normal, rec.u, rec.v);
-            rec.mat = mat;
+            rec.mat = mat.get();
 
+            RT_STAT(sphere_hits);
             return true;
         }
 
@@ -64,12 +67,57 @@ class sphere : public hittable {
             return bbox;
         }
 
+        void motion_bounds(aabb& open, aabb& close) const override {
+            auto rvec = vec3(radius, radius, radius);
+            open = aabb(center.at(0) - rvec, center.at(0) + rvec);
+            close = aabb(center.at(1) - rvec, center.at(1) + rvec);
+        }
+
+        // Light sampling picks directions uniformly inside the cone the sphere subtends. Emitters
+        // are assumed static, so a moving sphere is sampled at its shutter-open position.
+        double pdf_value(const point3& origin, const vec3& direction) const override {
+            hit_record rec;
+            if (!this->hit(ray(origin, direction), interval(0.001, infinity), rec))
+                return 0;
+
+            auto dist_squared = (center.at(0) - origin).length_squared();
+            if (dist_squared <= radius*radius)
+                return 1 / (4*pi);
+
+            auto cos_theta_max = std::sqrt(1 - radius*radius/dist_squared);
+            auto solid_angle = 2*pi*(1-cos_theta_max);
+
+            return 1 / solid_angle;
+        }
+
+        vec3 random(const point3& origin) const override {
+            vec3 direction = center.at(0) - origin;
+            auto distance_squared = direction.length_squared();
+            if (distance_squared <= radius*radius)
+                return random_unit_vector();
+
+            onb uvw(direction);
+            return uvw.transform(random_to_sphere(radius, distance_squared));
+        }
+
     private:
         ray center;
         double radius;
         shared_ptr<material> mat;
         aabb bbox;
 
+        static vec3 random_to_sphere(double radius, double distance_squared) {
+            auto r1 = random_double();
+            auto r2 = random_double();
+            auto z = 1 + r2*(std::sqrt(1-radius*radius/distance_squared) - 1);
+
+            auto phi = 2*pi*r1;
+            auto x = std::cos(phi) * std::sqrt(1-z*z);
+            auto y = std::sin(phi) * std::sqrt(1-z*z);
+
+            return vec3(x, y, z);
+        }
+
         static void get_sphere_uv(const point3& p, double& u, double& v) {
         
         auto theta = std::acos(-p.y());
@@ -0,0 +1,222 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Scheduling priority of a task_group. Workers always take queued high-priority work, from their
+// own deque or a victim's, before touching anything of lower priority.
+enum class task_priority { low, normal, high };
+
+// Tracks a batch of tasks submitted to a thread_pool so the submitter can wait for all of them.
+class task_group {
+  public:
+    explicit task_group(task_priority priority = task_priority::normal) : priority(priority) {}
+
+    const task_priority priority;
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    // Blocks until every task in the group has finished, or the timeout expires. Returns done().
+    template <typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return finished.wait_for(lock, timeout, [this] { return done(); });
+    }
+
+  private:
+    friend class thread_pool;
+
+    std::atomic<int> pending{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    void add() { pending.fetch_add(1, std::memory_order_relaxed); }
+
+    void complete() {
+        // Decrement under the lock so a waiter that sees the group finish cannot destroy it
+        // while this thread is still notifying.
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            finished.notify_all();
+    }
+};
+
+// Fixed-size pool of worker threads with one task deque per worker. A worker pops its own deque
+// from the back (most recently pushed, still warm in cache) and, when it runs dry, steals from the
+// front of the other workers' deques, so load balances itself without a single shared queue.
+class thread_pool {
+  public:
+    explicit thread_pool(int num_threads = 0) {
+        if (num_threads <= 0)
+            num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+        for (int i = 0; i < num_threads; i++)
+            queues.push_back(std::make_unique<worker_queue>());
+        for (int i = 0; i < num_threads; i++)
+            workers.emplace_back([this, i] { worker_loop(i); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    int size() const { return int(workers.size()); }
+
+    // Queues a task on the given worker's deque (-1 picks the calling worker, or round-robin when
+    // called from outside the pool).
+    void submit(task_group& group, std::function<void()> task, int worker = -1) {
+        if (worker < 0 || worker >= size())
+            worker = (current_pool() == this) ? current_worker() : int(next_queue++ % size());
+
+        group.add();
+        {
+            auto& q = *queues[worker];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.tasks[int(group.priority)].push_back(job{std::move(task), &group});
+        }
+        queued_at[int(group.priority)].fetch_add(1, std::memory_order_relaxed);
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every task in the group has finished. A worker thread waiting on a nested group
+    // keeps executing queued tasks instead of sleeping, so fork-join recursion cannot deadlock.
+    void wait(task_group& group) {
+        if (current_pool() != this) {
+            while (!group.wait_for(std::chrono::milliseconds(100))) {}
+            return;
+        }
+
+        job next;
+        while (!group.done()) {
+            if (try_pop(current_worker(), next))
+                run(next);
+            else
+                std::this_thread::yield();
+        }
+
+        // Let the thread that finished the last task release the group before it goes away.
+        std::lock_guard<std::mutex> lock(group.mutex);
+    }
+
+  private:
+    struct job {
+        std::function<void()> task;
+        task_group* group = nullptr;
+    };
+
+    static const int priority_levels = 3;
+
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<job> tasks[priority_levels];   // Indexed by task_priority
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{0};
+    std::atomic<int> queued_at[priority_levels] = {};
+    std::atomic<unsigned> next_queue{0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static thread_pool*& current_pool() {
+        static thread_local thread_pool* pool = nullptr;
+        return pool;
+    }
+
+    static int& current_worker() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    bool try_pop(int self, job& out) {
+        for (int level = priority_levels - 1; level >= 0; level--) {
+            if (queued_at[level].load(std::memory_order_relaxed) > 0 && try_pop(self, level, out))
+                return true;
+        }
+        return false;
+    }
+
+    bool try_pop(int self, int level, job& out) {
+        // Own deque first, newest task first.
+        {
+            auto& q = *queues[self];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            auto& tasks = q.tasks[level];
+            if (!tasks.empty()) {
+                out = std::move(tasks.back());
+                tasks.pop_back();
+                queued_at[level].fetch_sub(1, std::memory_order_relaxed);
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        // Steal the oldest task from the next non-empty victim.
+        int n = size();
+        for (int k = 1; k < n; k++) {
+            auto& q = *queues[(self + k) % n];
+            std::unique_lock<std::mutex> lock(q.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || q.tasks[level].empty())
+                continue;
+            auto& tasks = q.tasks[level];
+            out = std::move(tasks.front());
+            tasks.pop_front();
+            queued_at[level].fetch_sub(1, std::memory_order_relaxed);
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    static void run(job& j) {
+        j.task();
+        j.task = nullptr;
+        j.group->complete();
+    }
+
+    void worker_loop(int self) {
+        current_pool() = this;
+        current_worker() = self;
+
+        job next;
+        while (true) {
+            if (try_pop(self, next)) {
+                run(next);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] {
+                return stopping || queued.load(std::memory_order_acquire) > 0;
+            });
+            if (stopping && queued.load(std::memory_order_acquire) == 0)
+                return;
+        }
+    }
+};
+
+#endif
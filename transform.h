@@ -0,0 +1,120 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "rtweekend.h"
+#include "AABB.h"
+
+// An affine map p -> A p + b, stored as the 3x4 matrix [A | b].
+class affine_transform {
+  public:
+    double m[3][4];
+
+    affine_transform() : m{{1,0,0,0}, {0,1,0,0}, {0,0,1,0}} {}
+
+    static affine_transform translation(const vec3& offset) {
+        affine_transform t;
+        for (int row = 0; row < 3; row++)
+            t.m[row][3] = offset[row];
+        return t;
+    }
+
+    static affine_transform scaling(const vec3& factors) {
+        affine_transform t;
+        for (int row = 0; row < 3; row++)
+            t.m[row][row] = factors[row];
+        return t;
+    }
+
+    static affine_transform rotation_y(double degrees) {
+        auto radians = degrees_to_radians(degrees);
+        auto c = std::cos(radians), s = std::sin(radians);
+        affine_transform t;
+        t.m[0][0] =  c;  t.m[0][2] = s;
+        t.m[2][0] = -s;  t.m[2][2] = c;
+        return t;
+    }
+
+    // Rotation by the given angle counterclockwise about axis, looking down it toward the origin.
+    static affine_transform rotation(const vec3& axis, double degrees) {
+        auto radians = degrees_to_radians(degrees);
+        auto c = std::cos(radians), s = std::sin(radians);
+        auto a = unit_vector(axis);
+        affine_transform t;
+        for (int row = 0; row < 3; row++)
+            for (int col = 0; col < 3; col++)
+                t.m[row][col] = (1 - c) * a[row] * a[col] + (row == col ? c : 0);
+        t.m[0][1] -= s * a[2];  t.m[1][0] += s * a[2];
+        t.m[2][0] -= s * a[1];  t.m[0][2] += s * a[1];
+        t.m[1][2] -= s * a[0];  t.m[2][1] += s * a[0];
+        return t;
+    }
+
+    point3 point(const point3& p) const {
+        return point3(m[0][0]*p[0] + m[0][1]*p[1] + m[0][2]*p[2] + m[0][3],
+                      m[1][0]*p[0] + m[1][1]*p[1] + m[1][2]*p[2] + m[1][3],
+                      m[2][0]*p[0] + m[2][1]*p[1] + m[2][2]*p[2] + m[2][3]);
+    }
+
+    vec3 vector(const vec3& v) const {
+        return vec3(m[0][0]*v[0] + m[0][1]*v[1] + m[0][2]*v[2],
+                    m[1][0]*v[0] + m[1][1]*v[1] + m[1][2]*v[2],
+                    m[2][0]*v[0] + m[2][1]*v[1] + m[2][2]*v[2]);
+    }
+
+    // A^T v. Called on the inverse of a transform, this carries normals through the transform.
+    vec3 transposed_vector(const vec3& v) const {
+        return vec3(m[0][0]*v[0] + m[1][0]*v[1] + m[2][0]*v[2],
+                    m[0][1]*v[0] + m[1][1]*v[1] + m[2][1]*v[2],
+                    m[0][2]*v[0] + m[1][2]*v[1] + m[2][2]*v[2]);
+    }
+
+    // The box holding the transformed corners of box.
+    aabb box(const aabb& box) const {
+        point3 lo( infinity,  infinity,  infinity);
+        point3 hi(-infinity, -infinity, -infinity);
+        for (int corner = 0; corner < 8; corner++) {
+            auto p = point(point3(corner & 1 ? box.x.max : box.x.min,
+                                  corner & 2 ? box.y.max : box.y.min,
+                                  corner & 4 ? box.z.max : box.z.min));
+            for (int axis = 0; axis < 3; axis++) {
+                lo[axis] = std::fmin(lo[axis], p[axis]);
+                hi[axis] = std::fmax(hi[axis], p[axis]);
+            }
+        }
+        return aabb(lo, hi);
+    }
+
+    // The inverse map. A must be invertible.
+    affine_transform inverse() const {
+        double det = m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+                   - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+                   + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+        affine_transform t;
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++) {
+                // Cofactor of m[col][row], from the cyclic neighbours of col and row.
+                int r0 = (col + 1) % 3, r1 = (col + 2) % 3;
+                int c0 = (row + 1) % 3, c1 = (row + 2) % 3;
+                t.m[row][col] = (m[r0][c0]*m[r1][c1] - m[r0][c1]*m[r1][c0]) / det;
+            }
+        }
+        for (int row = 0; row < 3; row++)
+            t.m[row][3] = -(t.m[row][0]*m[0][3] + t.m[row][1]*m[1][3] + t.m[row][2]*m[2][3]);
+        return t;
+    }
+};
+
+// The transform applying b, then a.
+inline affine_transform operator*(const affine_transform& a, const affine_transform& b) {
+    affine_transform t;
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            t.m[row][col] = a.m[row][0]*b.m[0][col] + a.m[row][1]*b.m[1][col]
+                          + a.m[row][2]*b.m[2][col];
+        }
+        t.m[row][3] += a.m[row][3];
+    }
+    return t;
+}
+
+#endif
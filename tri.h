@@ -38,7 +38,10 @@ class tri : public hittable {
 
     aabb bounding_box() const override { return bbox; }
 
+    const vec3& vertex(int k) const { return k == 0 ? v1 : k == 1 ? v2 : v3; }
+
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        RT_STAT(tri_tests);
         auto denom = dot(normal, r.direction());
 
         // No hit if the ray is parallel to the triangle plane.
@@ -69,9 +72,10 @@ class tri : public hittable {
 
         rec.t = t;
         rec.p = intersection;
-        rec.mat = mat;
+        rec.mat = mat.get();
         rec.set_face_normal(r, normal);
 
+        RT_STAT(tri_hits);
         return true;
     }
 
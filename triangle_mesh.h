@@ -0,0 +1,220 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "linear_bvh.h"
+#include <cstdint>
+#include <vector>
+
+// A triangle mesh as one hittable: shared vertex positions in structure-of-arrays form (double,
+// or float for half the memory at some precision), three vertex indices per face, a material
+// index per face, and an internal BVH over the faces in linear_bvh's node format. A face costs
+// its 12 bytes of indices, its share of vertices and nodes, and 4 bytes of material index when
+// faces differ in material, against a few hundred bytes for a separately allocated tri. Faces
+// are intersected exactly as tri does, so a mesh renders the same as the same tris.
+template <typename Real = double>
+class basic_triangle_mesh : public hittable {
+  public:
+    // faces holds three indices into vertices per face. face_materials holds an index into
+    // materials per face, or is empty to give every face materials[0].
+    basic_triangle_mesh(const std::vector<point3>& vertices, std::vector<uint32_t> faces,
+                        std::vector<shared_ptr<material>> materials,
+                        std::vector<uint32_t> face_materials = {},
+                        const bvh_options& options = bvh_node::default_options())
+      : indices(std::move(faces)), face_materials(std::move(face_materials)),
+        materials(std::move(materials)) {
+        render_stats::scoped_phase timing(render_phase::bvh_build);
+        x.reserve(vertices.size());
+        y.reserve(vertices.size());
+        z.reserve(vertices.size());
+        for (const auto& v : vertices) {
+            x.push_back(Real(v.x()));
+            y.push_back(Real(v.y()));
+            z.push_back(Real(v.z()));
+        }
+        build(options);
+    }
+
+    // Adopts a mesh built earlier, as mesh_cache loads it: faces already in the order of the
+    // leaves of nodes, with the tree's box and depth.
+    basic_triangle_mesh(std::vector<Real> x, std::vector<Real> y, std::vector<Real> z,
+                        std::vector<uint32_t> faces, std::vector<shared_ptr<material>> materials,
+                        std::vector<uint32_t> face_materials, std::vector<linear_bvh_node> nodes,
+                        const aabb& bbox, int depth)
+      : x(std::move(x)), y(std::move(y)), z(std::move(z)), indices(std::move(faces)),
+        face_materials(std::move(face_materials)), materials(std::move(materials)),
+        nodes(std::move(nodes)), bbox(bbox), depth(depth) {}
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        const auto& origin = r.origin();
+        const auto& direction = r.direction();
+        double o[3] = {origin.x(), origin.y(), origin.z()};
+        double inv[3] = {1 / direction.x(), 1 / direction.y(), 1 / direction.z()};
+        bool negative[3] = {std::signbit(direction.x()), std::signbit(direction.y()),
+                            std::signbit(direction.z())};
+
+        uint32_t fixed[stack_size];
+        std::vector<uint32_t> heap;
+        uint32_t* stack = fixed;
+        if (depth > stack_size) {
+            heap.resize(depth);
+            stack = heap.data();
+        }
+
+        bool hit_anything = false;
+        int top = 0;
+        uint32_t index = 0;
+        while (true) {
+            const auto& node = nodes[index];
+            RT_STAT(bvh_nodes);
+            if (linear_bvh::box_hit(node, o, inv, negative, ray_t)) {
+                if (node.count == 0) {
+                    uint32_t near = index + 1, far = node.offset;
+                    if (negative[node.axis])
+                        std::swap(near, far);
+                    stack[top++] = far;
+                    index = near;
+                    continue;
+                }
+                for (uint32_t face = node.offset; face < node.offset + node.count; face++) {
+                    if (hit_face(face, r, ray_t, rec)) {
+                        hit_anything = true;
+                        ray_t.max = rec.t;
+                    }
+                }
+            }
+            if (top == 0)
+                break;
+            index = stack[--top];
+        }
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t face_count() const { return indices.size() / 3; }
+    size_t vertex_count() const { return x.size(); }
+
+    // Bytes held by the mesh's buffers, not counting its materials.
+    size_t memory_bytes() const {
+        return 3 * x.capacity() * sizeof(Real) + indices.capacity() * sizeof(uint32_t)
+             + face_materials.capacity() * sizeof(uint32_t)
+             + nodes.capacity() * sizeof(linear_bvh_node);
+    }
+
+    point3 vertex(uint32_t k) const { return point3(x[k], y[k], z[k]); }
+
+  private:
+    friend class mesh_cache;    // Saves the buffers
+
+    static const int stack_size = 64;
+
+    std::vector<Real> x, y, z;                      // Vertex positions
+    std::vector<uint32_t> indices;                  // Three per face, faces in leaf order
+    std::vector<uint32_t> face_materials;           // Per face; empty if all use materials[0]
+    std::vector<shared_ptr<material>> materials;
+    std::vector<linear_bvh_node> nodes;
+    aabb bbox;
+    int depth = 0;                                  // Nodes on the longest root-to-leaf path
+
+    // Stands in for a face while the BVH is built.
+    class face_proxy : public hittable {
+      public:
+        face_proxy(uint32_t face, const aabb& box) : face(face), box(box) {}
+
+        bool hit(const ray&, interval, hit_record&) const override { return false; }
+        aabb bounding_box() const override { return box; }
+
+        uint32_t face;
+        aabb box;
+    };
+
+    // Builds the BVH with a linear_bvh over one proxy per face, keeps its nodes, and reorders
+    // the faces into its leaf order. The proxies only live for the build.
+    void build(const bvh_options& options) {
+        hittable_list proxies;
+        proxies.objects.reserve(face_count());
+        for (uint32_t face = 0; face < face_count(); face++)
+            proxies.add(make_shared<face_proxy>(face, face_box(face)));
+
+        linear_bvh tree(std::move(proxies), options);
+
+        std::vector<uint32_t> ordered(indices.size());
+        std::vector<uint32_t> ordered_materials(face_materials.size());
+        for (size_t k = 0; k < tree.objects.size(); k++) {
+            auto face = static_cast<const face_proxy*>(tree.objects[k].get())->face;
+            for (int corner = 0; corner < 3; corner++)
+                ordered[3*k + corner] = indices[3*face + corner];
+            if (!face_materials.empty())
+                ordered_materials[k] = face_materials[face];
+        }
+        indices = std::move(ordered);
+        face_materials = std::move(ordered_materials);
+        nodes = std::move(tree.nodes);
+        nodes.shrink_to_fit();
+        bbox = tree.bbox;
+        depth = tree.depth;
+    }
+
+    // The face's bounds, as tri computes them.
+    aabb face_box(uint32_t face) const {
+        auto v1 = vertex(indices[3*face]), v2 = vertex(indices[3*face + 1]),
+             v3 = vertex(indices[3*face + 2]);
+        auto min_point = point3(
+            std::fmin(std::fmin(v1.x(), v2.x()), v3.x()),
+            std::fmin(std::fmin(v1.y(), v2.y()), v3.y()),
+            std::fmin(std::fmin(v1.z(), v2.z()), v3.z())
+        );
+        auto max_point = point3(
+            std::fmax(std::fmax(v1.x(), v2.x()), v3.x()),
+            std::fmax(std::fmax(v1.y(), v2.y()), v3.y()),
+            std::fmax(std::fmax(v1.z(), v2.z()), v3.z())
+        );
+        return aabb(min_point, max_point);
+    }
+
+    // tri::hit, with the face's normal and plane worked out from its vertices on the way.
+    bool hit_face(uint32_t face, const ray& r, interval ray_t, hit_record& rec) const {
+        RT_STAT(tri_tests);
+        auto v1 = vertex(indices[3*face]), v2 = vertex(indices[3*face + 1]),
+             v3 = vertex(indices[3*face + 2]);
+        vec3 area_abc = cross(v2 - v1, v3 - v1);
+        auto normal = unit_vector(area_abc);
+
+        auto denom = dot(normal, r.direction());
+        if (std::fabs(denom) < 1e-8)
+            return false;
+
+        auto t = (dot(normal, v1) - dot(normal, r.origin())) / denom;
+        if (!ray_t.contains(t))
+            return false;
+
+        auto intersection = r.at(t);
+        vec3 na = cross(v3 - v2, intersection - v2);
+        vec3 nb = cross(v1 - v3, intersection - v3);
+        vec3 nc = cross(v2 - v1, intersection - v1);
+
+        double u = dot(na, area_abc) / dot(area_abc, area_abc);
+        double v = dot(nb, area_abc) / dot(area_abc, area_abc);
+        double w = dot(nc, area_abc) / dot(area_abc, area_abc);
+        if (u < 0 || v < 0 || w < 0)
+            return false;
+
+        rec.t = t;
+        rec.p = intersection;
+        rec.u = v;
+        rec.v = w;
+        rec.mat = materials[face_materials.empty() ? 0 : face_materials[face]].get();
+        rec.set_face_normal(r, normal);
+
+        RT_STAT(tri_hits);
+        return true;
+    }
+};
+
+using triangle_mesh = basic_triangle_mesh<double>;
+using float_triangle_mesh = basic_triangle_mesh<float>;
+
+#endif
@@ -105,22 +105,46 @@ inline vec3 unit_vector(const vec3& v){
     return v / v.length();
 }
 
-inline vec3 random_in_unit_disk() {
-    while (true) {
-        auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
-        if (p.length_squared() < 1)
-            return p;
+// Closed-form warps from the unit square, so each output consumes exactly two uniform numbers and
+// stratified or low-discrepancy inputs stay well distributed after warping.
+
+inline vec3 sample_disk(double u1, double u2) {
+    // Shirley-Chiu concentric mapping onto the unit disk in the xy plane.
+    double a = 2*u1 - 1, b = 2*u2 - 1;
+    if (a == 0 && b == 0)
+        return vec3(0,0,0);
+    double r, phi;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        phi = (pi/4) * (b/a);
+    } else {
+        r = b;
+        phi = (pi/2) - (pi/4) * (a/b);
     }
+    return vec3(r * std::cos(phi), r * std::sin(phi), 0);
+}
+
+inline vec3 sample_sphere(double u1, double u2) {
+    // Uniform direction: z uniform in [-1,1] and a uniform azimuth.
+    auto z = 1 - 2*u1;
+    auto r = std::sqrt(std::fmax(0.0, 1 - z*z));
+    auto phi = 2*pi*u2;
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+inline vec3 sample_cosine_hemisphere(double u1, double u2) {
+    // Cosine-weighted direction about +z, by lifting a concentric disk sample (Malley's method).
+    auto d = sample_disk(u1, u2);
+    auto z = std::sqrt(std::fmax(0.0, 1 - d.x()*d.x() - d.y()*d.y()));
+    return vec3(d.x(), d.y(), z);
+}
+
+inline vec3 random_in_unit_disk() {
+    return sample_disk(random_double(), random_double());
 }
 
 inline vec3 random_unit_vector() {
-    while (true) {
-        auto p = vec3::random(-1,1);
-        auto lensq = p.length_squared();
-        if (1e-16 < lensq && lensq <= 1) {
-            return p / std::sqrt(lensq);
-        }
-    }
+    return sample_sphere(random_double(), random_double());
 }
 
 inline vec3 random_on_hemisphere(const vec3& normal) {
@@ -0,0 +1,123 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// State a path carries from one bounce to the next. The camera's one-path-at-a-time integrator
+// keeps a single one on the stack; the wavefront integrator keeps a whole batch of them.
+struct path_state {
+    ray r;
+    color throughput = color(1,1,1);
+    color radiance   = color(0,0,0);
+    double bsdf_pdf  = 0;       // Pdf of the bounce that produced r (0 = camera or specular)
+    int depth        = 0;
+
+    // First-hit AOVs, filled in by the first bounce when the camera records them.
+    color  first_albedo = color(0,0,0);
+    vec3   first_normal = vec3(0,0,0);
+    double first_depth  = infinity;
+
+    path_state() {}
+    explicit path_state(const ray& r) : r(r) {}
+};
+
+// One in-flight sample of the wavefront integrator: its path, its pixel and sample number, the
+// random stream it draws from between stages, and the result of its latest intersection.
+struct wavefront_path {
+    path_state state;
+    rng_stream rng;
+    int i, j, n;
+    bool hit;
+    hit_record rec;
+};
+
+// A queue of indices into a batch of wavefront paths. Each stage walks the queue in order, so
+// sorting it before a stage decides the order in which the stage touches the scene.
+class wavefront_queue {
+  public:
+    std::vector<uint32_t> items;
+
+    bool empty() const { return items.empty(); }
+    size_t size() const { return items.size(); }
+    void clear() { items.clear(); }
+    void push(uint32_t index) { items.push_back(index); }
+
+    // Reorders the queue by ray, so rays that start close together and point the same way are
+    // traced back to back and walk the same parts of the BVH while they are still in cache.
+    void sort_by_ray(const std::vector<wavefront_path>& paths, const aabb& bounds) {
+        sort_by([&](uint32_t k) { return ray_key(paths[k].state.r, bounds); });
+    }
+
+    // Groups hits by material so each material's scatter code and textures stay hot while its
+    // hits are shaded. Misses (no material) come first.
+    void sort_by_material(const std::vector<wavefront_path>& paths) {
+        sort_by([&](uint32_t k) {
+            const auto& p = paths[k];
+            return p.hit ? uint64_t(reinterpret_cast<uintptr_t>(p.rec.mat)) : uint64_t(0);
+        });
+    }
+
+    // Key: direction octant in the top 3 bits, then the Morton code of the origin within the
+    // scene bounds (10 bits per axis), then the Morton code of the direction (7 bits per axis).
+    static uint64_t ray_key(const ray& r, const aabb& bounds) {
+        const auto& o = r.origin();
+        const auto& d = r.direction();
+
+        uint64_t octant = (d.x() < 0 ? 4 : 0) | (d.y() < 0 ? 2 : 0) | (d.z() < 0 ? 1 : 0);
+
+        uint64_t origin_code = morton3(quantize(o.x(), bounds.x, 1023),
+                                       quantize(o.y(), bounds.y, 1023),
+                                       quantize(o.z(), bounds.z, 1023));
+
+        auto len = d.length();
+        interval unit(-1, 1);
+        uint64_t direction_code = len > 0
+            ? morton3(quantize(d.x() / len, unit, 127), quantize(d.y() / len, unit, 127),
+                      quantize(d.z() / len, unit, 127))
+            : 0;
+
+        return (octant << 51) | (origin_code << 21) | direction_code;
+    }
+
+  private:
+    std::vector<std::pair<uint64_t, uint32_t>> keyed;
+
+    template <typename Key>
+    void sort_by(Key key) {
+        keyed.clear();
+        keyed.reserve(items.size());
+        for (auto k : items)
+            keyed.emplace_back(key(k), k);
+        std::sort(keyed.begin(), keyed.end());
+        for (size_t m = 0; m < keyed.size(); m++)
+            items[m] = keyed[m].second;
+    }
+
+    static uint32_t quantize(double x, const interval& range, uint32_t max_cell) {
+        auto extent = range.max - range.min;
+        if (!(extent > 0))
+            return 0;
+        auto cell = (x - range.min) / extent * max_cell;
+        return uint32_t(std::fmin(std::fmax(cell, 0.0), double(max_cell)));
+    }
+
+    static uint64_t spread_bits(uint64_t x) {
+        // Spreads the low 10 bits of x so two zero bits separate each one.
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x << 8))  & 0x0300f00f;
+        x = (x | (x << 4))  & 0x030c30c3;
+        x = (x | (x << 2))  & 0x09249249;
+        return x;
+    }
+
+    static uint64_t morton3(uint32_t x, uint32_t y, uint32_t z) {
+        return (spread_bits(x) << 2) | (spread_bits(y) << 1) | spread_bits(z);
+    }
+};
+
+#endif
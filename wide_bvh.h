@@ -0,0 +1,267 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "linear_bvh.h"
+#include "ray_packet.h"
+#include <cstdint>
+#include <vector>
+
+// One node of a wide_bvh: the bounds of up to N children in structure-of-arrays form, so one
+// SIMD slab test covers 4 (SSE) or 8 (AVX) of them. Bounds are floats padded outward, as in
+// linear_bvh_node. 128 bytes for N = 4, 256 for N = 8.
+template <int N>
+struct alignas(32) wide_bvh_node {
+    float    lo[3][N], hi[3][N];    // lo[axis][child]
+    uint32_t offset[N];             // Interior child: its node index; leaf child: its first object
+    uint16_t count[N];              // Objects in a leaf child; 0 for an interior child
+    uint8_t  children;              // Slots in use, which come first
+};
+
+static_assert(sizeof(wide_bvh_node<4>) == 128, "wide_bvh_node<4> should fill two cache lines");
+static_assert(sizeof(wide_bvh_node<8>) == 256, "wide_bvh_node<8> should fill four cache lines");
+
+// A BVH with up to N children per node, made by collapsing a binary linear_bvh: each node takes
+// in the grandchildren of its largest interior children until it has N. A ray tests all the
+// children of a node at once, then visits those it hits nearest first, skipping any that start
+// beyond the closest hit so far. Packets have no wide path; their rays are traced one at a time.
+template <int N>
+class wide_bvh : public hittable {
+    static_assert(N == 4 || N == 8, "wide_bvh nodes have 4 or 8 children");
+
+  public:
+    wide_bvh(hittable_list list, const bvh_options& options = bvh_node::default_options()) {
+        render_stats::scoped_phase timing(render_phase::bvh_build);
+        linear_bvh binary(std::move(list), options);
+        objects = std::move(binary.objects);
+        bbox = binary.bbox;
+        if (binary.nodes.empty())
+            return;
+        nodes.reserve(binary.nodes.size() / (N - 1) + 1);
+        collapse(binary.nodes, 0, 1);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        const auto& origin = r.origin();
+        const auto& direction = r.direction();
+        float o[3] = {float(origin.x()), float(origin.y()), float(origin.z())};
+        float inv[3] = {safe_inverse(direction.x()), safe_inverse(direction.y()),
+                        safe_inverse(direction.z())};
+        float err[3] = {ray_packet::slab_error(origin.x(), inv[0]),
+                        ray_packet::slab_error(origin.y(), inv[1]),
+                        ray_packet::slab_error(origin.z(), inv[2])};
+
+        // A child waiting to be visited, with where the ray enters its box.
+        struct entry { uint32_t offset; uint16_t count; float tnear; };
+        entry fixed[stack_size * (N - 1) + 1];
+        std::vector<entry> heap;
+        entry* stack = fixed;
+        if (depth > stack_size) {
+            heap.resize(depth * (N - 1) + 1);
+            stack = heap.data();
+        }
+
+        bool hit_anything = false;
+        float tmin = float_below(ray_t.min), tmax = float_above(ray_t.max);
+        int top = 0;
+        stack[top++] = {0, 0, tmin};
+        while (top > 0) {
+            auto current = stack[--top];
+            if (current.tnear > tmax)
+                continue;
+
+            if (current.count > 0) {
+                for (uint32_t k = current.offset; k < current.offset + current.count; k++) {
+                    if (objects[k]->hit(r, ray_t, rec)) {
+                        hit_anything = true;
+                        ray_t.max = rec.t;
+                    }
+                }
+                tmax = float_above(ray_t.max);
+                continue;
+            }
+
+            const auto& node = nodes[current.offset];
+            RT_STAT(bvh_nodes);
+            RT_STAT_ADD(aabb_tests, node.children);
+            alignas(32) float tnear[N];
+            uint32_t mask = box_hit(node, o, inv, err, tmin, tmax, tnear);
+
+            // Sort the children hit by entry distance, then push them farthest first.
+            int order[N], hits = 0;
+            for (; mask; mask &= mask - 1) {
+                int child = lowest_bit(mask), k = hits++;
+                for (; k > 0 && tnear[order[k - 1]] > tnear[child]; k--)
+                    order[k] = order[k - 1];
+                order[k] = child;
+            }
+            for (int k = hits - 1; k >= 0; k--) {
+                int child = order[k];
+                stack[top++] = {node.offset[child], node.count[child], tnear[child]};
+            }
+        }
+        return hit_anything;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t node_count() const { return nodes.size(); }
+
+  private:
+    static const int stack_size = 64;
+
+    std::vector<wide_bvh_node<N>> nodes;
+    std::vector<shared_ptr<hittable>> objects;  // In the order of the binary tree's leaves
+    aabb bbox;
+    int depth = 0;                              // Nodes on the longest root-to-leaf path
+
+    // Appends the wide node over the binary subtree at index, at the given depth, and returns
+    // its index. A binary root that is itself a leaf becomes the only child of the wide root.
+    uint32_t collapse(const std::vector<linear_bvh_node>& binary, uint32_t index, int level) {
+        depth = std::max(depth, level);
+        auto wide_index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        uint32_t slots[N];
+        int n = 0;
+        if (binary[index].count > 0) {
+            slots[n++] = index;
+        } else {
+            slots[n++] = index + 1;
+            slots[n++] = binary[index].offset;
+        }
+
+        // Open the interior child with the largest surface area, the one most rays will enter,
+        // until the node is full or only leaves remain.
+        while (n < N) {
+            int widest = -1;
+            float widest_area = -1;
+            for (int k = 0; k < n; k++) {
+                const auto& child = binary[slots[k]];
+                if (child.count > 0)
+                    continue;
+                float dx = child.hi[0] - child.lo[0], dy = child.hi[1] - child.lo[1],
+                      dz = child.hi[2] - child.lo[2];
+                float area = dx*dy + dy*dz + dz*dx;
+                if (area > widest_area) {
+                    widest = k;
+                    widest_area = area;
+                }
+            }
+            if (widest < 0)
+                break;
+            auto opened = slots[widest];
+            slots[widest] = opened + 1;
+            slots[n++] = binary[opened].offset;
+        }
+
+        for (int k = 0; k < N; k++) {
+            for (int axis = 0; axis < 3; axis++) {
+                // Unused slots are zeroed; box_hit masks them out.
+                nodes[wide_index].lo[axis][k] = k < n ? binary[slots[k]].lo[axis] : 0;
+                nodes[wide_index].hi[axis][k] = k < n ? binary[slots[k]].hi[axis] : 0;
+            }
+            nodes[wide_index].offset[k] = 0;
+            nodes[wide_index].count[k] = 0;
+        }
+        nodes[wide_index].children = uint8_t(n);
+
+        for (int k = 0; k < n; k++) {
+            const auto& child = binary[slots[k]];
+            if (child.count > 0) {
+                nodes[wide_index].offset[k] = child.offset;
+                nodes[wide_index].count[k] = child.count;
+            } else {
+                auto child_index = collapse(binary, slots[k], level + 1);
+                nodes[wide_index].offset[k] = child_index;
+            }
+        }
+        return wide_index;
+    }
+
+    // Float copies of the ray's interval, rounded outward as in ray_packet::set_tmax so the box
+    // test never misses a child the double-precision ray would enter.
+    static float float_below(double t) {
+        if (std::isinf(t)) return float(t);
+        return float(t) - 1e-6f * std::fabs(float(t)) - 1e-6f;
+    }
+
+    static float float_above(double t) {
+        if (std::isinf(t)) return float(t);
+        return float(t) + 1e-6f * std::fabs(float(t)) + 1e-6f;
+    }
+
+    // 1/d, but finite when d is zero, so a ray lying in a box's face plane gets (lo - o) * inv
+    // = 0 instead of the NaN of 0 * inf, which the SIMD min and max would not ignore.
+    static float safe_inverse(double d) {
+        float inv = float(1 / d);
+        return std::isinf(inv) ? std::copysign(std::numeric_limits<float>::max(), inv) : inv;
+    }
+
+    static int lowest_bit(uint32_t mask) {
+        int k = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            k++;
+        }
+        return k;
+    }
+
+    // Slab-tests the ray against every child box of the node, returning the mask of those it
+    // enters within [tmin, tmax] and where it enters each. Each axis's slab is widened by err,
+    // the ray's slab errors (see ray_packet::slab_error).
+    static uint32_t box_hit(const wide_bvh_node<N>& node, const float o[3], const float inv[3],
+                            const float err[3], float tmin, float tmax, float tnear_out[N]) {
+        uint32_t result = 0;
+#if defined(RT_PACKET_AVX)
+        if constexpr (N == 8) {
+            __m256 tnear = _mm256_set1_ps(tmin);
+            __m256 tfar = _mm256_set1_ps(tmax);
+            for (int axis = 0; axis < 3; axis++) {
+                auto origin = _mm256_set1_ps(o[axis]), inverse = _mm256_set1_ps(inv[axis]);
+                auto error = _mm256_set1_ps(err[axis]);
+                auto t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.lo[axis]), origin), inverse);
+                auto t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.hi[axis]), origin), inverse);
+                tnear = _mm256_max_ps(tnear, _mm256_sub_ps(_mm256_min_ps(t0, t1), error));
+                tfar  = _mm256_min_ps(tfar,  _mm256_add_ps(_mm256_max_ps(t0, t1), error));
+            }
+            _mm256_store_ps(tnear_out, tnear);
+            result = uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ)));
+            return result & ((1u << node.children) - 1);
+        }
+#endif
+#if defined(RT_PACKET_AVX) || defined(RT_PACKET_SSE)
+        for (int base = 0; base < N; base += 4) {
+            __m128 tnear = _mm_set1_ps(tmin);
+            __m128 tfar = _mm_set1_ps(tmax);
+            for (int axis = 0; axis < 3; axis++) {
+                auto origin = _mm_set1_ps(o[axis]), inverse = _mm_set1_ps(inv[axis]);
+                auto error = _mm_set1_ps(err[axis]);
+                auto t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.lo[axis] + base), origin), inverse);
+                auto t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.hi[axis] + base), origin), inverse);
+                tnear = _mm_max_ps(tnear, _mm_sub_ps(_mm_min_ps(t0, t1), error));
+                tfar  = _mm_min_ps(tfar,  _mm_add_ps(_mm_max_ps(t0, t1), error));
+            }
+            _mm_store_ps(tnear_out + base, tnear);
+            result |= uint32_t(_mm_movemask_ps(_mm_cmple_ps(tnear, tfar))) << base;
+        }
+#else
+        for (int k = 0; k < N; k++) {
+            float tnear = tmin, tfar = tmax;
+            for (int axis = 0; axis < 3; axis++) {
+                float t0 = (node.lo[axis][k] - o[axis]) * inv[axis];
+                float t1 = (node.hi[axis][k] - o[axis]) * inv[axis];
+                tnear = std::fmax(tnear, std::fmin(t0, t1) - err[axis]);
+                tfar = std::fmin(tfar, std::fmax(t0, t1) + err[axis]);
+            }
+            tnear_out[k] = tnear;
+            if (tnear <= tfar) result |= 1u << k;
+        }
+#endif
+        return result & ((1u << node.children) - 1);
+    }
+};
+
+#endif